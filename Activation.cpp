@@ -0,0 +1,221 @@
+static void
+BuildActivationGraph(map_desc* Map, memory_arena* Arena)
+{
+    activation_graph Graph = {};
+    
+    u32 EntityCount = Map->Entities.Count;
+    u32 BodyCount = Map->RigidBodies.Count;
+    
+    //Count each entity's targets, then lay them out back to back
+    Graph.FirstTarget = AllocSpan(Arena, u32, EntityCount + 1);
+    for (rigid_body& RigidBody : Map->RigidBodies)
+    {
+        if (RigidBody.ActivatedByIndex)
+        {
+            Assert(RigidBody.ActivatedByIndex < EntityCount);
+            Graph.FirstTarget[RigidBody.ActivatedByIndex]++;
+        }
+    }
+    for (laser& Laser : Map->Lasers)
+    {
+        if (Laser.ActivatedByIndex)
+        {
+            Assert(Laser.ActivatedByIndex < EntityCount);
+            Graph.FirstTarget[Laser.ActivatedByIndex]++;
+        }
+    }
+    
+    u32 TargetCount = 0;
+    for (u32 EntityIndex = 0; EntityIndex <= EntityCount; EntityIndex++)
+    {
+        u32 Count = Graph.FirstTarget[EntityIndex];
+        Graph.FirstTarget[EntityIndex] = TargetCount;
+        TargetCount += Count;
+    }
+    
+    Graph.Targets = AllocSpan(Arena, activation_target, TargetCount);
+    u32* Filled = AllocArray(Arena, u32, EntityCount);
+    for (u32 BodyIndex = 0; BodyIndex < BodyCount; BodyIndex++)
+    {
+        u32 Activator = Map->RigidBodies[BodyIndex].ActivatedByIndex;
+        if (Activator)
+        {
+            Graph.Targets[Graph.FirstTarget[Activator] + Filled[Activator]++] = {Activates_Body, BodyIndex};
+        }
+    }
+    for (u32 LaserIndex = 0; LaserIndex < Map->Lasers.Count; LaserIndex++)
+    {
+        laser* Laser = Map->Lasers + LaserIndex;
+        if (Laser->ActivatedByIndex)
+        {
+            Graph.Targets[Graph.FirstTarget[Laser->ActivatedByIndex] + Filled[Laser->ActivatedByIndex]++] = {Activates_Laser, LaserIndex};
+        }
+        
+        //Nothing is activated yet
+        Laser->Powered = (Laser->ActivatedByIndex == 0);
+    }
+    
+    Graph.Activated = AllocStaticArray(Arena, u32, EntityCount);
+    Graph.NowActivated = AllocStaticArray(Arena, u32, EntityCount);
+    
+    //Driven bodies start wherever the map put them, so they all ease towards their unactivated state first
+    Graph.MovingBodies = AllocStaticArray(Arena, u32, BodyCount);
+    Graph.IsMoving = AllocArray(Arena, bool, BodyCount);
+    Graph.KeepsMoving = AllocArray(Arena, bool, BodyCount);
+    for (u32 BodyIndex = 0; BodyIndex < BodyCount; BodyIndex++)
+    {
+        if (Map->RigidBodies[BodyIndex].ActivatedByIndex)
+        {
+            Graph.IsMoving[BodyIndex] = true;
+            Graph.KeepsMoving[BodyIndex] = IsDynamic(&Map->Physics, BodyIndex);
+            Add(&Graph.MovingBodies, BodyIndex);
+        }
+    }
+    for (attachment Attachment : Map->Attachments)
+    {
+        u32 BodyIndex = Map->Entities[Attachment.EntityIndex].RigidBodyIndex;
+        if (BodyIndex && Map->RigidBodies[BodyIndex].ActivatedByIndex)
+        {
+            Graph.KeepsMoving[BodyIndex] = true;
+        }
+    }
+    
+    Map->ActivationGraph = Graph;
+}
+
+static void
+SetActivation(map_desc* Map, u32 EntityIndex, bool Activated)
+{
+    activation_graph* Graph = &Map->ActivationGraph;
+    
+    Map->Entities[EntityIndex].WasActivated = Activated;
+    
+    for (u32 TargetIndex = Graph->FirstTarget[EntityIndex]; TargetIndex < Graph->FirstTarget[EntityIndex + 1]; TargetIndex++)
+    {
+        activation_target Target = Graph->Targets[TargetIndex];
+        if (Target.Type == Activates_Body)
+        {
+            if (!Graph->IsMoving[Target.Index])
+            {
+                Graph->IsMoving[Target.Index] = true;
+                Add(&Graph->MovingBodies, Target.Index);
+            }
+        }
+        else
+        {
+            Map->Lasers[Target.Index].Powered = Activated;
+        }
+    }
+}
+
+//Marks an entity hit in its own color during this tick's laser stage
+static inline void
+ActivateEntity(map_desc* Map, u32 EntityIndex)
+{
+    entity* Entity = Map->Entities + EntityIndex;
+    if (!Entity->IsActivated)
+    {
+        Entity->IsActivated = true;
+        Add(&Map->ActivationGraph.NowActivated, EntityIndex);
+    }
+}
+
+//Clears what was activated last tick, before the laser stage activates things again
+static void
+BeginActivations(map_desc* Map)
+{
+    activation_graph* Graph = &Map->ActivationGraph;
+    for (u32 EntityIndex : Graph->Activated)
+    {
+        Map->Entities[EntityIndex].IsActivated = false;
+    }
+    Graph->NowActivated.Count = 0;
+}
+
+//Publishes IsActivated to WasActivated once every laser is traced, so one laser's result doesn't depend on
+//the order. Only entities that were or are now activated can have flipped.
+static void
+EndActivations(map_desc* Map)
+{
+    activation_graph* Graph = &Map->ActivationGraph;
+    
+    for (u32 EntityIndex : Graph->Activated)
+    {
+        if (!Map->Entities[EntityIndex].IsActivated)
+        {
+            SetActivation(Map, EntityIndex, false);
+        }
+    }
+    for (u32 EntityIndex : Graph->NowActivated)
+    {
+        if (!Map->Entities[EntityIndex].WasActivated)
+        {
+            SetActivation(Map, EntityIndex, true);
+        }
+    }
+    
+    static_array<u32> Swap = Graph->Activated;
+    Graph->Activated = Graph->NowActivated;
+    Graph->NowActivated = Swap;
+    Graph->NowActivated.Count = 0;
+
+#if DEBUG
+    //Same result as publishing and re-deriving everything
+    for (entity& Entity : Map->Entities)
+    {
+        Assert(Entity.WasActivated == Entity.IsActivated);
+    }
+    for (laser& Laser : Map->Lasers)
+    {
+        Assert(Laser.Powered == (Laser.ActivatedByIndex == 0 || Map->Entities[Laser.ActivatedByIndex].WasActivated));
+    }
+#endif
+}
+
+//Eases driven bodies towards the state their activator is in. The easing stalls within an ulp of the target,
+//after that nothing changes until the activator flips again, so the body drops out of the list.
+static void
+MoveDrivenBodies(map_desc* Map, f32 DeltaTime)
+{
+    physics_world* World = &Map->Physics;
+    activation_graph* Graph = &Map->ActivationGraph;
+    
+    for (u32 Slot = 0; Slot < Graph->MovingBodies.Count;)
+    {
+        u32 BodyIndex = Graph->MovingBodies[Slot];
+        rigid_body* RigidBody = Map->RigidBodies + BodyIndex;
+        
+        bool Activated = Map->Entities[RigidBody->ActivatedByIndex].WasActivated;
+        
+        v2 TargetP, TargetSize;
+        if (Activated)
+        {
+            TargetP = RigidBody->ActivatedP;
+            TargetSize = RigidBody->ActivatedSize;
+        }
+        else
+        {
+            TargetP = RigidBody->UnactivatedP;
+            TargetSize = RigidBody->UnactivatedSize;
+        }
+        
+        v2 OldP = BodyP(World, BodyIndex);
+        v2 OldSize = BodySize(World, BodyIndex);
+        
+        f32 Speed = 3.0f;
+        BodyP(World, BodyIndex) = LinearInterpolate(OldP, TargetP, DeltaTime * Speed);
+        BodySize(World, BodyIndex) = LinearInterpolate(OldSize, TargetSize, DeltaTime * Speed);
+        
+        bool Settled = (BodyP(World, BodyIndex) == OldP && BodySize(World, BodyIndex) == OldSize);
+        if (Settled && !Graph->KeepsMoving[BodyIndex])
+        {
+            Graph->IsMoving[BodyIndex] = false;
+            Graph->MovingBodies.Count--;
+            Graph->MovingBodies.Memory[Slot] = Graph->MovingBodies.Memory[Graph->MovingBodies.Count];
+        }
+        else
+        {
+            Slot++;
+        }
+    }
+}
@@ -1,5 +1,5 @@
-void AddLine(console* Console, string String);
-void ClearConsole(console* Console);
+static void AddLine(console* Console, string String);
+static void ClearConsole(console* Console);
 
 #define CONSOLE_COMMAND(Console, Command) \
 AddCommand(Console, String(#Command), Command_ ## Command)
@@ -86,6 +86,305 @@ void Command_color(int ArgCount, string* Args, console* Console, game_state* Gam
     SelectedElement->Color = NewColor;
 }
 
+void Command_physics_stats(int ArgCount, string* Args, console* Console, game_state* GameState, memory_arena* Arena)
+{
+    physics_stats Stats = GameState->Map->Broadphase.Stats;
+    
+    string Result = ArenaPrint(Arena, "%u bodies, %u candidate pairs, %u of %u pairs culled", 
+                               Stats.BodyCount, Stats.CandidatePairs, Stats.CulledPairs, Stats.BruteForcePairs);
+    AddLine(Console, Result);
+    
+    Result = ArenaPrint(Arena, "%u awake, %u sleeping, %u islands, %u solver jobs", 
+                        Stats.AwakeBodies, Stats.SleepingBodies, Stats.IslandCount, Stats.SolverJobs);
+    AddLine(Console, Result);
+    
+    Result = ArenaPrint(Arena, "%u contacts, %u warm started, %u velocity passes, deepest %.4f", 
+                        Stats.ContactCount, Stats.WarmStartedContacts, Stats.SolverIterations, Stats.DeepestPenetration);
+    AddLine(Console, Result);
+    
+    Result = ArenaPrint(Arena, "%u bodies swept, %u hit something", Stats.SweptBodies, Stats.SweptHits);
+    AddLine(Console, Result);
+}
+
+void Command_broadphase(int ArgCount, string* Args, console* Console, game_state* GameState, memory_arena* Arena)
+{
+    broadphase* Broadphase = &GameState->Map->Broadphase;
+    
+    if (ArgCount == 2)
+    {
+        if (StringsAreEqual(Args[1], String("grid")))
+        {
+            Broadphase->Mode = Broadphase_Grid;
+        }
+        else if (StringsAreEqual(Args[1], String("sap")))
+        {
+            Broadphase->Mode = Broadphase_SweepAndPrune;
+        }
+        else if (StringsAreEqual(Args[1], String("brute")))
+        {
+            Broadphase->Mode = Broadphase_BruteForce;
+        }
+        else
+        {
+            AddLine(Console, String("Expected grid, sap or brute"));
+        }
+    }
+    
+    const char* ModeNames[] = {"grid", "sap", "brute"};
+    string Result = ArenaPrint(Arena, "Broadphase: %s", ModeNames[Broadphase->Mode]);
+    AddLine(Console, Result);
+}
+
+//Sets Flag from an on or off argument, then prints it after Label
+static void
+ParseOnOff(console* Console, int ArgCount, string* Args, bool* Flag, char* Label, memory_arena* Arena)
+{
+    if (ArgCount == 2)
+    {
+        if (StringsAreEqual(Args[1], String("on")))
+        {
+            *Flag = true;
+        }
+        else if (StringsAreEqual(Args[1], String("off")))
+        {
+            *Flag = false;
+        }
+        else
+        {
+            AddLine(Console, String("Expected on or off"));
+        }
+    }
+    
+    string Result = ArenaPrint(Arena, "%s: %s", Label, *Flag ? "on" : "off");
+    AddLine(Console, Result);
+}
+
+void Command_sleep(int ArgCount, string* Args, console* Console, game_state* GameState, memory_arena* Arena)
+{
+    ParseOnOff(Console, ArgCount, Args, &GameState->Map->Physics.SleepingEnabled, "Sleeping", Arena);
+}
+
+void Command_threads(int ArgCount, string* Args, console* Console, game_state* GameState, memory_arena* Arena)
+{
+    ParseOnOff(Console, ArgCount, Args, &GameState->Map->Physics.Multithreaded, "Multithreaded physics", Arena);
+}
+
+void Command_ccd(int ArgCount, string* Args, console* Console, game_state* GameState, memory_arena* Arena)
+{
+    ParseOnOff(Console, ArgCount, Args, &GameState->Map->Physics.ContinuousCollision, "Continuous collision", Arena);
+}
+
+void Command_laser_stats(int ArgCount, string* Args, console* Console, game_state* GameState, memory_arena* Arena)
+{
+    laser_stats Stats = GameState->Map->LaserStats;
+    
+    u32 Total = Stats.CacheHits + Stats.Retraces;
+    f32 HitRate = Total ? 100.0f * Stats.CacheHits / Total : 0.0f;
+    string Result = ArenaPrint(Arena, "%u laser traces reused, %u retraced (%.1f%% reused)", Stats.CacheHits, Stats.Retraces, HitRate);
+    AddLine(Console, Result);
+    
+    Result = ArenaPrint(Arena, "%u rays cast, %u bounces", Stats.RaysCast, Stats.Bounces);
+    AddLine(Console, Result);
+}
+
+//laser_kernel_check [rays], compares every SIMD ray kernel this CPU runs with the scalar reference
+void Command_laser_kernel_check(int ArgCount, string* Args, console* Console, game_state* GameState, memory_arena* Arena)
+{
+    u32 RayCount = (ArgCount >= 2) ? StringToU32(Args[1]) : 10000;
+    ray_kernel_check Check = CheckRaySegmentsKernels(RayCount, 1, Arena);
+    
+    string Result = ArenaPrint(Arena, "%u rays against %u segments, %u hits, %u differ from TestRayIntersection", 
+                               Check.Rays, Check.Segments, Check.Hits, Check.BaselineDifferences);
+    AddLine(Console, Result);
+    
+    const char* LevelNames[] = {"scalar", "sse2", "avx2"};
+    for (u32 Level = Simd_SSE2; Level <= (u32)GlobalMaxSimdLevel; Level++)
+    {
+        Result = ArenaPrint(Arena, "%s: %u mismatches", LevelNames[Level], Check.Mismatches[Level]);
+        AddLine(Console, Result);
+    }
+}
+
+void Command_laser_cache(int ArgCount, string* Args, console* Console, game_state* GameState, memory_arena* Arena)
+{
+    ParseOnOff(Console, ArgCount, Args, &GameState->Map->LaserCaching, "Laser caching", Arena);
+}
+
+void Command_laser_mode(int ArgCount, string* Args, console* Console, game_state* GameState, memory_arena* Arena)
+{
+    map_desc* Map = GameState->Map;
+    
+    if (ArgCount == 2)
+    {
+        if (StringsAreEqual(Args[1], String("bvh")))
+        {
+            Map->LaserMode = LaserTrace_BVH;
+        }
+        else if (StringsAreEqual(Args[1], String("grid")))
+        {
+            Map->LaserMode = LaserTrace_Grid;
+        }
+        else if (StringsAreEqual(Args[1], String("brute")))
+        {
+            Map->LaserMode = LaserTrace_BruteForce;
+        }
+        else
+        {
+            AddLine(Console, String("Expected bvh, grid or brute"));
+        }
+    }
+    
+    const char* ModeNames[] = {"bvh", "grid", "brute"};
+    string Result = ArenaPrint(Arena, "Laser tracing: %s", ModeNames[Map->LaserMode]);
+    AddLine(Console, Result);
+}
+
+void Command_laser_threads(int ArgCount, string* Args, console* Console, game_state* GameState, memory_arena* Arena)
+{
+    ParseOnOff(Console, ArgCount, Args, &GameState->Map->MultithreadedLasers, "Multithreaded lasers", Arena);
+}
+
+void Command_warm_start(int ArgCount, string* Args, console* Console, game_state* GameState, memory_arena* Arena)
+{
+    ParseOnOff(Console, ArgCount, Args, &GameState->Map->Physics.WarmStarting, "Warm starting", Arena);
+}
+
+void Command_solver_iterations(int ArgCount, string* Args, console* Console, game_state* GameState, memory_arena* Arena)
+{
+    physics_world* World = &GameState->Map->Physics;
+    
+    if (ArgCount == 2)
+    {
+        u32 Iterations = StringToU32(Args[1]);
+        if (Iterations >= 1 && Iterations <= 64)
+        {
+            World->VelocityIterations = Iterations;
+        }
+        else
+        {
+            AddLine(Console, String("Expected 1 to 64 iterations"));
+        }
+    }
+    
+    string Result = ArenaPrint(Arena, "Most velocity passes per step: %u", World->VelocityIterations);
+    AddLine(Console, Result);
+}
+
+//solver_bench [steps] [iterations], runs the current map with and without warm starting and puts it back
+void Command_solver_bench(int ArgCount, string* Args, console* Console, game_state* GameState, memory_arena* Arena)
+{
+    map_desc* Map = GameState->Map;
+    
+    if (Map->Broadphase.Mode == Broadphase_BruteForce)
+    {
+        AddLine(Console, String("The brute force broadphase doesn't use the contact solver"));
+        return;
+    }
+    
+    u32 Steps = (ArgCount >= 2) ? StringToU32(Args[1]) : 600;
+    u32 Iterations = (ArgCount >= 3) ? StringToU32(Args[2]) : Map->Physics.VelocityIterations;
+    if (Steps == 0 || Iterations == 0)
+    {
+        AddLine(Console, String("Expected at least one step and one iteration"));
+        return;
+    }
+    
+    f32 TimeStep = 1.0f / GameState->TicksPerSecond;
+    solver_benchmark Cold = BenchmarkSolver(Map, false, Iterations, Steps, TimeStep, Arena);
+    solver_benchmark Warm = BenchmarkSolver(Map, true, Iterations, Steps, TimeStep, Arena);
+    
+    solver_benchmark Runs[] = {Cold, Warm};
+    const char* RunNames[] = {"Cold", "Warm"};
+    for (u32 RunIndex = 0; RunIndex < ArrayCount(Runs); RunIndex++)
+    {
+        solver_benchmark Run = Runs[RunIndex];
+        string Result = ArenaPrint(Arena, "%s: %.2f velocity passes per step, %u of %u contacts warm started, deepest %.4f", 
+                                   RunNames[RunIndex], (f32)Run.Iterations / Run.Steps, 
+                                   Run.WarmStartedContacts, Run.Contacts, Run.DeepestPenetration);
+        AddLine(Console, Result);
+    }
+    
+    if (Cold.Iterations > 0)
+    {
+        f32 Saved = 100.0f * (1.0f - (f32)Warm.Iterations / Cold.Iterations);
+        string Result = ArenaPrint(Arena, "Warm starting saved %.1f%% of velocity passes", Saved);
+        AddLine(Console, Result);
+    }
+}
+
+void Command_tick_rate(int ArgCount, string* Args, console* Console, game_state* GameState, memory_arena* Arena)
+{
+    if (ArgCount == 2)
+    {
+        u32 TicksPerSecond = StringToU32(Args[1]);
+        if (TicksPerSecond >= 10 && TicksPerSecond <= 1000)
+        {
+            GameState->TicksPerSecond = (f32)TicksPerSecond;
+        }
+        else
+        {
+            AddLine(Console, String("Expected 10 to 1000 ticks per second"));
+        }
+    }
+    
+    string Result = ArenaPrint(Arena, "Physics ticks per second: %u", (u32)GameState->TicksPerSecond);
+    AddLine(Console, Result);
+}
+
+void Command_simd(int ArgCount, string* Args, console* Console, game_state* GameState, memory_arena* Arena)
+{
+    if (ArgCount == 2)
+    {
+        simd_level Level = GlobalSimdLevel;
+        if (StringsAreEqual(Args[1], String("scalar")))
+        {
+            Level = Simd_Scalar;
+        }
+        else if (StringsAreEqual(Args[1], String("sse2")))
+        {
+            Level = Simd_SSE2;
+        }
+        else if (StringsAreEqual(Args[1], String("avx2")))
+        {
+            Level = Simd_AVX2;
+        }
+        else
+        {
+            AddLine(Console, String("Expected scalar, sse2 or avx2"));
+        }
+        
+        if (Level > GlobalMaxSimdLevel)
+        {
+            AddLine(Console, String("Not supported by this CPU"));
+        }
+        else
+        {
+            GlobalSimdLevel = Level;
+        }
+    }
+    
+    const char* LevelNames[] = {"scalar", "sse2", "avx2"};
+    string Result = ArenaPrint(Arena, "SIMD: %s (max %s)", LevelNames[GlobalSimdLevel], LevelNames[GlobalMaxSimdLevel]);
+    AddLine(Console, Result);
+}
+
+//narrowphase_check [pairs], compares every SIMD narrowphase kernel this CPU runs with the scalar reference
+void Command_narrowphase_check(int ArgCount, string* Args, console* Console, game_state* GameState, memory_arena* Arena)
+{
+    u32 PairCount = (ArgCount >= 2) ? StringToU32(Args[1]) : 10000;
+    narrowphase_kernel_check Check = CheckNarrowphaseKernels(PairCount, 1, Arena);
+    
+    string Result = ArenaPrint(Arena, "%u pairs of each shape combination, %u contacts", Check.Pairs, Check.Contacts);
+    AddLine(Console, Result);
+    
+    const char* LevelNames[] = {"scalar", "sse2", "avx2"};
+    for (u32 Level = Simd_SSE2; Level <= (u32)GlobalMaxSimdLevel; Level++)
+    {
+        Result = ArenaPrint(Arena, "%s: %u mismatches", LevelNames[Level], Check.Mismatches[Level]);
+        AddLine(Console, Result);
+    }
+}
+
 static void
 AddLine(console* Console, string String)
 {
@@ -191,6 +490,22 @@ UpdateConsole(game_state* GameState, console* Console, game_input* Input, memory
         CONSOLE_COMMAND(Console, clear);
         CONSOLE_COMMAND(Console, activated);
         CONSOLE_COMMAND(Console, color);
+        CONSOLE_COMMAND(Console, physics_stats);
+        CONSOLE_COMMAND(Console, broadphase);
+        CONSOLE_COMMAND(Console, simd);
+        CONSOLE_COMMAND(Console, narrowphase_check);
+        CONSOLE_COMMAND(Console, sleep);
+        CONSOLE_COMMAND(Console, threads);
+        CONSOLE_COMMAND(Console, tick_rate);
+        CONSOLE_COMMAND(Console, warm_start);
+        CONSOLE_COMMAND(Console, solver_iterations);
+        CONSOLE_COMMAND(Console, solver_bench);
+        CONSOLE_COMMAND(Console, ccd);
+        CONSOLE_COMMAND(Console, laser_stats);
+        CONSOLE_COMMAND(Console, laser_kernel_check);
+        CONSOLE_COMMAND(Console, laser_cache);
+        CONSOLE_COMMAND(Console, laser_mode);
+        CONSOLE_COMMAND(Console, laser_threads);
     }
     
     //Check if toggled
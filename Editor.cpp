@@ -33,6 +33,7 @@ SerialiseMap(memory_arena* Arena, map_desc* Map)
     saved_map_header* Header = (saved_map_header*)Data.Memory;
     
     Header->ElementCount = Map->Elements.Count;
+    Header->Version = SavedMapVersion;
     Header->ElementSize = sizeof(map_element);
     
     map_element* Elements = (map_element*)(Data.Memory + sizeof(saved_map_header));
@@ -55,14 +56,26 @@ DeserialiseMap(memory_arena* Arena, span<u8> Data)
             PlatformDebugOut(String("Warning: Map element has different size\n"));
         }
         
+        //Older layouts were also 80 bytes, but what they kept where BounceLimit is now isn't a bounce limit
+        bool HasBounceLimits = (Header->Version >= 2);
+        if (!HasBounceLimits)
+        {
+            PlatformDebugOut(String("Warning: Map saved before bounce limits, lasers get the default\n"));
+        }
+        
         Map = AllocStruct(Arena, map_desc);
         
         span<map_element> Elements = AllocSpan(Arena, map_element, Header->ElementCount);
+        u32 CopySize = (Header->ElementSize < sizeof(map_element)) ? Header->ElementSize : sizeof(map_element);
         
         u8* Buffer = (u8*)(Header + 1);
         for (u32 ElementIndex = 0; ElementIndex < Header->ElementCount; ElementIndex++)
         {
-            memcpy(&Elements[ElementIndex], Buffer, Header->ElementSize);
+            memcpy(&Elements[ElementIndex], Buffer, CopySize);
+            if (!HasBounceLimits)
+            {
+                Elements[ElementIndex].BounceLimit = 0;
+            }
             Buffer += Header->ElementSize;
         }
         
@@ -279,6 +292,7 @@ RunEditor(render_group* Group, game_state* GameState, game_input* Input, allocat
         Laser.Shape.Size = V2(0.01f, 0.01f);
         Laser.Angle = 0.0f;
         Laser.Color = 0xFF00FF00;
+        Laser.BounceLimit = DefaultBounceLimit;
         Add(&Map->Elements, &Laser, PArena);
     }
     
@@ -420,6 +434,22 @@ RunEditor(render_group* Group, game_state* GameState, game_input* Input, allocat
             {
                 SelectedElement->Angle += 0.125f;
             }
+            
+            Layout.NextRow();
+            Layout.Label("Bounces");
+            
+            u32 BounceLimit = BounceLimitOf(SelectedElement);
+            if (Layout.Button("<") && BounceLimit > 1)
+            {
+                SelectedElement->BounceLimit = BounceLimit - 1;
+            }
+            
+            if (Layout.Button(">") && BounceLimit < MaxBounceLimit)
+            {
+                SelectedElement->BounceLimit = BounceLimit + 1;
+            }
+            
+            Layout.Label(ArenaPrint(TArena, "%u", BounceLimitOf(SelectedElement)));
         }
         
         Layout.NextRow();
@@ -518,6 +548,16 @@ RunEditor(render_group* Group, game_state* GameState, game_input* Input, allocat
     }
 }
 
+static u32
+AddRigidBody(static_array<rigid_body>* RigidBodies, physics_world* World, rigid_body RigidBody, v2 P, v2 Size, f32 InvMass)
+{
+    u32 Result = Add(RigidBodies, RigidBody);
+    u32 BodyIndex = AddBody(World, P, Size, InvMass);
+    Assert(Result == BodyIndex);
+    (void)BodyIndex; //Only checked in debug builds, AddBody always has to run
+    return Result;
+}
+
 static void
 CreateComponents(map_desc* Map, memory_arena* MapArena)
 {
@@ -529,19 +569,17 @@ CreateComponents(map_desc* Map, memory_arena* MapArena)
     static_array<attachment> Attachments = AllocStaticArray(MapArena, attachment, ComponentMaxCount);
     static_array<line> Lines =             AllocStaticArray(MapArena, line, ComponentMaxCount);
     static_array<laser> Lasers =           AllocStaticArray(MapArena, laser, ComponentMaxCount);
+    physics_world Physics =                CreatePhysicsWorld(MapArena, ComponentMaxCount);
     
     //TODO: I hate this
     Add(&Lasers, {});
     
     rigid_body PlayerRigidBody = {};
-    PlayerRigidBody.P = V2(0.5f, 0.3f);
-    PlayerRigidBody.Size = V2(0.025f, 0.025f);
-    PlayerRigidBody.InvMass = 1.0f;
     PlayerRigidBody.Color = 0xFFC0C0C0;
     
     entity* Player = &Map->Player;
     *Player = {Entity_Player};
-    Player->RigidBodyIndex = Add(&RigidBodies, PlayerRigidBody);
+    Player->RigidBodyIndex = AddRigidBody(&RigidBodies, &Physics, PlayerRigidBody, V2(0.5f, 0.3f), V2(0.025f, 0.025f), 1.0f);
     
     for (u32 MapElementIndex = 0; MapElementIndex < Map->Elements.Count; MapElementIndex++)
     {
@@ -557,31 +595,22 @@ CreateComponents(map_desc* Map, memory_arena* MapArena)
             {
                 rigid_body RigidBody = {};
                 RigidBody.Type = RigidBody_AABB;
-                RigidBody.P = MapElem.Shape.Position;
-                RigidBody.Size  = MapElem.Shape.Size;
-                RigidBody.InvMass = 1.0f;
                 RigidBody.Color = MapElem.Color;
                 
-                RigidBodyIndex = Add(&RigidBodies, RigidBody);
+                RigidBodyIndex = AddRigidBody(&RigidBodies, &Physics, RigidBody, MapElem.Shape.Position, MapElem.Shape.Size, 1.0f);
             } break;
             case MapElem_Circle:
             {
                 rigid_body RigidBody = {};
                 RigidBody.Type = RigidBody_Circle;
-                RigidBody.P = MapElem.Shape.Position;
-                RigidBody.Size  = MapElem.Shape.Size;
-                RigidBody.InvMass = 1.0f;
                 RigidBody.Color = MapElem.Color;
                 
-                RigidBodyIndex = Add(&RigidBodies, RigidBody);
+                RigidBodyIndex = AddRigidBody(&RigidBodies, &Physics, RigidBody, MapElem.Shape.Position, MapElem.Shape.Size, 1.0f);
                 
             } break;
             case MapElem_Rectangle: case MapElem_Window: case MapElem_Receiver:
             {
                 rigid_body RigidBody = {};
-                RigidBody.P = MapElem.Shape.Position;
-                RigidBody.Size  = MapElem.Shape.Size;
-                RigidBody.InvMass = 0.0f;
                 RigidBody.Translucent = (MapElem.Type == MapElem_Window || MapElem.Type == MapElem_Laser);
                 RigidBody.Color = MapElem.Color;
                 RigidBody.ActivatedByIndex = MapElem.ActivatedBy;
@@ -590,7 +619,7 @@ CreateComponents(map_desc* Map, memory_arena* MapArena)
                 RigidBody.UnactivatedP = MapElem.UnactivatedShape.Position;
                 RigidBody.UnactivatedSize = MapElem.UnactivatedShape.Size;
                 
-                RigidBodyIndex = Add(&RigidBodies, RigidBody);
+                RigidBodyIndex = AddRigidBody(&RigidBodies, &Physics, RigidBody, MapElem.Shape.Position, MapElem.Shape.Size, 0.0f);
             } break;
             case MapElem_Reflector: case MapElem_Line:
             {
@@ -609,6 +638,7 @@ CreateComponents(map_desc* Map, memory_arena* MapArena)
                 Laser.Angle = MapElem.Angle;
                 Laser.Position = MapElem.Shape.Position;
                 Laser.ActivatedByIndex = MapElem.ActivatedBy;
+                Laser.MaxBeams = BounceLimitOf(&MapElem) + 1;
                 
                 LaserIndex = Add(&Lasers, Laser);
             }
@@ -617,6 +647,12 @@ CreateComponents(map_desc* Map, memory_arena* MapArena)
             }
         }
         
+        if (RigidBodyIndex)
+        {
+            rigid_body* RigidBody = RigidBodies + RigidBodyIndex;
+            RigidBody->Static = (BodyInvMass(&Physics, RigidBodyIndex) == 0.0f && !MapElem.ActivatedBy && !MapElem.AttachedTo);
+        }
+        
         if (MapElem.AttachedTo)
         {
             Assert(RigidBodyIndex || LineIndex || LaserIndex);
@@ -657,6 +693,26 @@ CreateComponents(map_desc* Map, memory_arena* MapArena)
     Map->Lines = Lines;
     Map->Lasers = Lasers;
     Map->Attachments = Attachments;
+    Map->Physics = Physics;
+    
+    Map->PrevLineStarts = AllocSpan(MapArena, v2, Lines.Count);
+    for (u32 LineIndex = 0; LineIndex < Lines.Count; LineIndex++)
+    {
+        Map->PrevLineStarts[LineIndex] = Lines[LineIndex].Start;
+    }
+    Map->PrevLaserPositions = AllocSpan(MapArena, v2, Lasers.Count);
+    for (u32 LaserIndex = 0; LaserIndex < Lasers.Count; LaserIndex++)
+    {
+        Map->PrevLaserPositions[LaserIndex] = Lasers[LaserIndex].Position;
+    }
+    
+    BuildStaticGeometry(Map, MapArena);
+    BuildBroadphase(Map, MapArena);
+    BuildLaserBVH(Map, MapArena);
+    BuildLaserGrid(Map, MapArena);
+    AllocLaserTraces(Map, MapArena);
+    BuildActivationGraph(Map, MapArena);
+    BuildEntityColors(Map, MapArena);
 }
 
 static void
@@ -0,0 +1,328 @@
+//Runs the game without a window or a GPU. Every frame is drawn by the software rasteriser, and the time spent
+//updating and drawing is reported at the end. Builds on any platform with the same unity build as the game:
+//HeadlessRender [map index] [frames] [output.tga] [worker threads]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Utilities.cpp"
+#include "Maths.cpp"
+
+#include "Puzzle.h"
+
+#define STB_TRUETYPE_IMPLEMENTATION
+#define STBTT_STATIC
+#include "stb_truetype.h"
+
+//Platform Functions
+void HeadlessDebugOut(string String);
+void HeadlessSleep(int Milliseconds);
+span<u8> HeadlessLoadFile(memory_arena* Arena, char* Path);
+void HeadlessSaveFile(char* Path, span<u8> Data);
+f32 HeadlessTextWidth(string String, f32 FontSize);
+void HeadlessAddWork(work_queue* Queue, work_queue_callback* Callback, void* Data);
+void HeadlessCompleteAllWork(work_queue* Queue);
+
+#define PlatformDebugOut        HeadlessDebugOut
+#define PlatformSleep           HeadlessSleep
+#define PlatformLoadFile        HeadlessLoadFile
+#define PlatformSaveFile        HeadlessSaveFile
+#define PlatformTextWidth       HeadlessTextWidth
+#define PlatformAddWork         HeadlessAddWork
+#define PlatformCompleteAllWork HeadlessCompleteAllWork
+
+struct work_queue_entry
+{
+    work_queue_callback* Callback;
+    void* Data;
+};
+
+//The same queue as the Win32 one, with a condition variable for its semaphore
+struct work_queue
+{
+    std::atomic<u32> CompletionGoal;
+    std::atomic<u32> CompletionCount;
+    
+    std::atomic<u32> NextEntryToWrite;
+    std::atomic<u32> NextEntryToRead;
+    std::mutex Mutex;
+    std::condition_variable WorkAdded;
+    
+    work_queue_entry Entries[256];
+};
+
+work_queue* GlobalWorkQueue;
+
+void HeadlessCreateWorkQueue(work_queue* Queue, u32 ThreadCount);
+
+#include "Puzzle.cpp"
+#include "SoftwareRender.cpp"
+
+software_font* GlobalFont;
+
+static memory_arena
+HeadlessCreateMemoryArena(u64 Size, memory_arena_type Type)
+{
+    memory_arena Arena = {};
+    
+    Arena.Buffer = (u8*)calloc(1, Size);
+    Arena.Size = Size;
+    Arena.Type = Type;
+    
+    return Arena;
+}
+
+static f64
+SecondsSince(std::chrono::steady_clock::time_point Start)
+{
+    std::chrono::duration<f64> Elapsed = std::chrono::steady_clock::now() - Start;
+    return Elapsed.count();
+}
+
+//Uncompressed 32 bit TGA, BGRA with the top row first
+static void
+WriteTGA(char* Path, u8* RGBA, u32 Width, u32 Height)
+{
+    FILE* File = fopen(Path, "wb");
+    if (!File)
+    {
+        fprintf(stderr, "Could not open %s\n", Path);
+        return;
+    }
+    
+    u8 Header[18] = {};
+    Header[2] = 2; //Uncompressed true colour
+    Header[12] = (u8)(Width & 0xFF);
+    Header[13] = (u8)(Width >> 8);
+    Header[14] = (u8)(Height & 0xFF);
+    Header[15] = (u8)(Height >> 8);
+    Header[16] = 32;
+    Header[17] = 0x28; //8 alpha bits, top left origin
+    fwrite(Header, 1, sizeof(Header), File);
+    
+    for (u32 I = 0; I < Width * Height; I++)
+    {
+        u8 BGRA[4] = {RGBA[4 * I + 2], RGBA[4 * I + 1], RGBA[4 * I + 0], RGBA[4 * I + 3]};
+        fwrite(BGRA, 1, sizeof(BGRA), File);
+    }
+    
+    fclose(File);
+}
+
+int main(int ArgCount, char** Args)
+{
+    u32 MapIndex = (ArgCount > 1) ? (u32)atoi(Args[1]) : 0;
+    u32 FrameCount = (ArgCount > 2) ? (u32)atoi(Args[2]) : 300;
+    char* OutputPath = (ArgCount > 3) ? Args[3] : 0;
+    
+    //The main thread works on the queue too while it waits
+    u32 HardwareThreads = std::thread::hardware_concurrency();
+    u32 ThreadCount = (ArgCount > 4) ? (u32)atoi(Args[4]) : ((HardwareThreads > 1) ? HardwareThreads - 1 : 0);
+    
+    work_queue* WorkQueue = new work_queue();
+    if (ThreadCount > 0)
+    {
+        HeadlessCreateWorkQueue(WorkQueue, ThreadCount);
+        GlobalWorkQueue = WorkQueue;
+    }
+    
+    u32 const Width = 1280;
+    u32 const Height = 720;
+    
+    memory_arena TransientArena = HeadlessCreateMemoryArena(Megabytes(16), TRANSIENT);
+    memory_arena PermanentArena = HeadlessCreateMemoryArena(Megabytes(16), PERMANENT);
+    memory_arena FramebufferArena = HeadlessCreateMemoryArena(4 * sizeof(f32) * Width * Height + Width * Height * 4 + Megabytes(1), NORMAL);
+    
+    allocator Allocator = {};
+    Allocator.Transient = &TransientArena;
+    Allocator.Permanent = &PermanentArena;
+    
+    span<u8> FontFile = HeadlessLoadFile(&TransientArena, "assets/LiberationMono-Regular.ttf");
+    GlobalFont = CreateSoftwareFont(&PermanentArena, FontFile);
+    ResetArena(&TransientArena);
+    
+    game_state* GameState = GameInitialise(Allocator);
+    if (MapIndex < GameState->Maps.Count)
+    {
+        ChangeMap(GameState, MapIndex, Allocator.Permanent);
+    }
+    CreateComponents(GameState->Map, &GameState->MapArena);
+    
+    software_framebuffer Framebuffer = CreateFramebuffer(&FramebufferArena, Width, Height);
+    u8* Pixels = Alloc(&FramebufferArena, Width * Height * 4);
+    
+    render_group* RenderGroup = (render_group*)calloc(1, sizeof(render_group));
+    
+    f64 UpdateSeconds = 0.0;
+    f64 RenderSeconds = 0.0;
+    u64 ShapeCount = 0;
+    
+    for (u32 Frame = 0; Frame < FrameCount; Frame++)
+    {
+        game_input Input = {};
+        Input.TextInput = (char*)"";
+        
+        ResetArena(&TransientArena);
+        RenderGroup->ShapeCount = 0;
+        
+        std::chrono::steady_clock::time_point UpdateStart = std::chrono::steady_clock::now();
+        GameUpdateAndRender(RenderGroup, GameState, 1.0f / 60.0f, &Input, Allocator);
+        UpdateSeconds += SecondsSince(UpdateStart);
+        
+        std::chrono::steady_clock::time_point RenderStart = std::chrono::steady_clock::now();
+        ClearFramebuffer(&Framebuffer, V4(0.1f, 0.2f, 0.3f, 1.0f));
+        SoftwareRender(RenderGroup, &Framebuffer, GlobalFont, &TransientArena);
+        RenderSeconds += SecondsSince(RenderStart);
+        
+        ShapeCount += RenderGroup->ShapeCount;
+    }
+    
+    if (FrameCount > 0)
+    {
+        printf("%u frames of map %u at %ux%u, %.1f shapes a frame, %u worker threads\n", 
+               FrameCount, GameState->MapIndex, Width, Height, (f64)ShapeCount / FrameCount, ThreadCount);
+        printf("update %.3f ms, render %.3f ms a frame\n", 1e3 * UpdateSeconds / FrameCount, 1e3 * RenderSeconds / FrameCount);
+    }
+    
+    if (OutputPath)
+    {
+        ResolveFramebuffer(&Framebuffer, Pixels);
+        WriteTGA(OutputPath, Pixels, Width, Height);
+    }
+    
+    return 0;
+}
+
+void HeadlessDebugOut(string String)
+{
+    fprintf(stderr, "%.*s", (int)String.Length, String.Text);
+}
+
+void HeadlessSleep(int Milliseconds)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(Milliseconds));
+}
+
+span<u8>
+HeadlessLoadFile(memory_arena* Arena, char* Path)
+{
+    span<u8> Result = {};
+    
+    FILE* File = fopen(Path, "rb");
+    if (File)
+    {
+        fseek(File, 0, SEEK_END);
+        long FileSize = ftell(File);
+        fseek(File, 0, SEEK_SET);
+        
+        if (FileSize > 0)
+        {
+            Result.Memory = Alloc(Arena, FileSize);
+            Result.Count = (u32)fread(Result.Memory, 1, FileSize, File);
+        }
+        fclose(File);
+    }
+    
+    return Result;
+}
+
+void
+HeadlessSaveFile(char* Path, span<u8> Data)
+{
+    FILE* File = fopen(Path, "wb");
+    if (File)
+    {
+        fwrite(Data.Memory, 1, Data.Count, File);
+        fclose(File);
+    }
+}
+
+f32 HeadlessTextWidth(string String, f32 FontSize)
+{
+    f32 Result = SoftwareTextWidth(GlobalFont, String);
+    return Result;
+}
+
+//Only the main thread adds work
+void HeadlessAddWork(work_queue* Queue, work_queue_callback* Callback, void* Data)
+{
+    u32 NextEntryToWrite = Queue->NextEntryToWrite.load(std::memory_order_relaxed);
+    u32 NewNextEntryToWrite = (NextEntryToWrite + 1) % ArrayCount(Queue->Entries);
+    Assert(NewNextEntryToWrite != Queue->NextEntryToRead.load());
+    
+    work_queue_entry* Entry = Queue->Entries + NextEntryToWrite;
+    Entry->Callback = Callback;
+    Entry->Data = Data;
+    Queue->CompletionGoal++;
+    
+    //Publishes the entry before the index moves past it
+    {
+        std::lock_guard<std::mutex> Lock(Queue->Mutex);
+        Queue->NextEntryToWrite.store(NewNextEntryToWrite, std::memory_order_release);
+    }
+    Queue->WorkAdded.notify_one();
+}
+
+static bool
+HeadlessDoNextWorkEntry(work_queue* Queue)
+{
+    bool ShouldSleep = false;
+    
+    u32 OriginalNextEntryToRead = Queue->NextEntryToRead.load();
+    u32 NewNextEntryToRead = (OriginalNextEntryToRead + 1) % ArrayCount(Queue->Entries);
+    if (OriginalNextEntryToRead != Queue->NextEntryToWrite.load(std::memory_order_acquire))
+    {
+        if (Queue->NextEntryToRead.compare_exchange_strong(OriginalNextEntryToRead, NewNextEntryToRead))
+        {
+            work_queue_entry Entry = Queue->Entries[OriginalNextEntryToRead];
+            Entry.Callback(Entry.Data);
+            Queue->CompletionCount++;
+        }
+    }
+    else
+    {
+        ShouldSleep = true;
+    }
+    
+    return ShouldSleep;
+}
+
+void HeadlessCompleteAllWork(work_queue* Queue)
+{
+    while (Queue->CompletionGoal != Queue->CompletionCount)
+    {
+        HeadlessDoNextWorkEntry(Queue);
+    }
+    
+    Queue->CompletionGoal = 0;
+    Queue->CompletionCount = 0;
+}
+
+static void
+HeadlessWorkerThread(work_queue* Queue)
+{
+    while (true)
+    {
+        if (HeadlessDoNextWorkEntry(Queue))
+        {
+            std::unique_lock<std::mutex> Lock(Queue->Mutex);
+            Queue->WorkAdded.wait(Lock, [Queue] { return Queue->NextEntryToRead.load() != Queue->NextEntryToWrite.load(); });
+        }
+    }
+}
+
+void HeadlessCreateWorkQueue(work_queue* Queue, u32 ThreadCount)
+{
+    for (u32 ThreadIndex = 0; ThreadIndex < ThreadCount; ThreadIndex++)
+    {
+        std::thread Thread(HeadlessWorkerThread, Queue);
+        Thread.detach();
+    }
+}
@@ -0,0 +1,420 @@
+//Headless benchmark for the laser stage. Builds synthetic maps with N reflectors, M lasers and K windows, creates
+//their components the same way the editor does and then runs only the laser stage for a fixed number of frames.
+//Built as its own console program on any platform, the same unity build as the game without a window or a device:
+//LaserBenchmark [output.csv] [frames]
+//LaserBenchmark check [rays] compares the SIMD ray kernels with the scalar reference instead, and every trace mode
+//with brute force while boxes move through the beams. It fails on any mismatch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "Utilities.cpp"
+#include "Maths.cpp"
+
+#include "Puzzle.h"
+
+//Platform Functions
+void BenchDebugOut(string String);
+void BenchSleep(int Milliseconds);
+span<u8> BenchLoadFile(memory_arena* Arena, char* Path);
+void BenchSaveFile(char* Path, span<u8> Data);
+f32 BenchTextWidth(string String, f32 FontSize);
+void BenchAddWork(work_queue* Queue, work_queue_callback* Callback, void* Data);
+void BenchCompleteAllWork(work_queue* Queue);
+
+#define PlatformDebugOut        BenchDebugOut
+#define PlatformSleep           BenchSleep
+#define PlatformLoadFile        BenchLoadFile
+#define PlatformSaveFile        BenchSaveFile
+#define PlatformTextWidth       BenchTextWidth
+#define PlatformAddWork         BenchAddWork
+#define PlatformCompleteAllWork BenchCompleteAllWork
+
+//There are no worker threads, so the laser stage traces every batch on the calling thread
+struct work_queue
+{
+    u32 Unused;
+};
+
+work_queue* GlobalWorkQueue;
+
+#include "Puzzle.cpp"
+
+static memory_arena
+BenchCreateMemoryArena(u64 Size, memory_arena_type Type)
+{
+    memory_arena Arena = {};
+    
+    Arena.Buffer = (u8*)calloc(1, Size);
+    Arena.Size = Size;
+    Arena.Type = Type;
+    
+    return Arena;
+}
+
+struct bench_scene
+{
+    u32 ReflectorCount;
+    u32 LaserCount;
+    u32 WindowCount;
+    u32 BoxCount; //Only the checks move bodies, the benchmark scenes have none
+    u32 ReceiverCount;
+};
+
+struct bench_result
+{
+    f64 Seconds;
+    u64 RaysCast;
+    u64 Bounces;
+};
+
+//Everything is placed inside four opaque walls, so beams end on a wall unless they run out of bounces first.
+//The same scene always gets the same random numbers.
+static map_desc*
+CreateBenchmarkMap(memory_arena* Arena, bench_scene Scene)
+{
+    srand(Scene.ReflectorCount * 7919 + Scene.LaserCount * 104729 + Scene.WindowCount);
+    
+    u32 Colors[] = {0xFFFF0000, 0xFF00FF00, 0xFF0000FF};
+    u32 Filters[] = {0x80FF00FF, 0x80FFFF00, 0x8000FFFF};
+    
+    map_desc* Map = AllocStruct(Arena, map_desc);
+    
+    u32 ElementCount = 5 + Scene.ReflectorCount + Scene.LaserCount + Scene.WindowCount + Scene.BoxCount + Scene.ReceiverCount;
+    span<map_element> Elements = AllocSpan(Arena, map_element, ElementCount);
+    u32 Count = 1; //Element 0 is the null element
+    
+    v2 WallPositions[] = {V2(0.5f, 0.01f), V2(0.5f, 0.59f), V2(0.01f, 0.3f), V2(0.99f, 0.3f)};
+    v2 WallSizes[] = {V2(1.0f, 0.02f), V2(1.0f, 0.02f), V2(0.02f, 0.6f), V2(0.02f, 0.6f)};
+    for (u32 Index = 0; Index < ArrayCount(WallPositions); Index++)
+    {
+        map_element* Element = Elements + Count++;
+        Element->Type = MapElem_Rectangle;
+        Element->Shape.Position = WallPositions[Index];
+        Element->Shape.Size = WallSizes[Index];
+        Element->Color = 0xFFFFFFFF;
+    }
+    
+    for (u32 Index = 0; Index < Scene.ReflectorCount; Index++)
+    {
+        f32 Length = RandomBetween(0.03f, 0.08f);
+        f32 Angle = RandomBetween(0.0f, 2 * 3.14159f);
+        
+        map_element* Element = Elements + Count++;
+        Element->Type = MapElem_Reflector;
+        Element->Shape.Start = V2(RandomBetween(0.05f, 0.9f), RandomBetween(0.05f, 0.5f));
+        Element->Shape.Offset = Length * V2(cosf(Angle), sinf(Angle));
+        Element->Color = 0xFF808080;
+    }
+    
+    for (u32 Index = 0; Index < Scene.WindowCount; Index++)
+    {
+        map_element* Element = Elements + Count++;
+        Element->Type = MapElem_Window;
+        Element->Shape.Position = V2(RandomBetween(0.05f, 0.95f), RandomBetween(0.05f, 0.55f));
+        Element->Shape.Size = V2(0.015f, 0.06f);
+        Element->Color = Filters[Index % ArrayCount(Filters)];
+    }
+    
+    for (u32 Index = 0; Index < Scene.LaserCount; Index++)
+    {
+        map_element* Element = Elements + Count++;
+        Element->Type = MapElem_Laser;
+        Element->Shape.Position = V2(RandomBetween(0.05f, 0.95f), RandomBetween(0.05f, 0.55f));
+        Element->Shape.Size = V2(0.01f, 0.01f);
+        Element->Angle = Random();
+        Element->Color = Colors[Index % ArrayCount(Colors)];
+    }
+    
+    //After the lasers, so the scenes without them get the same random numbers as before
+    for (u32 Index = 0; Index < Scene.BoxCount; Index++)
+    {
+        map_element* Element = Elements + Count++;
+        Element->Type = MapElem_Box;
+        Element->Shape.Position = V2(RandomBetween(0.05f, 0.95f), RandomBetween(0.05f, 0.55f));
+        Element->Shape.Size = V2(0.03f, 0.03f);
+        Element->Color = 0xFFFFFFFF;
+    }
+    
+    for (u32 Index = 0; Index < Scene.ReceiverCount; Index++)
+    {
+        map_element* Element = Elements + Count++;
+        Element->Type = MapElem_Receiver;
+        Element->Shape.Position = V2(RandomBetween(0.05f, 0.95f), RandomBetween(0.05f, 0.55f));
+        Element->Shape.Size = V2(0.02f, 0.02f);
+        Element->Color = Colors[Index % ArrayCount(Colors)];
+    }
+    
+    Assert(Count == ElementCount);
+    Map->Elements = Array(Elements);
+    
+    return Map;
+}
+
+//Caching is turned off so that every frame traces every laser, which is the cost of a frame where everything moved
+static bench_result
+RunBenchmark(bench_scene Scene, laser_trace_mode Mode, u32 FrameCount, memory_arena* SceneArena, memory_arena* MapArena, memory_arena* TArena)
+{
+    ResetArena(SceneArena);
+    map_desc* Map = CreateBenchmarkMap(SceneArena, Scene);
+    CreateComponents(Map, MapArena);
+    
+    Map->LaserMode = Mode;
+    Map->LaserCaching = false;
+    
+    //The first frame builds the traces and the activations, it isn't counted
+    ResetArena(TArena);
+    TraceLasers(Map, TArena);
+    Map->LaserStats = {};
+    
+    std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+    
+    for (u32 Frame = 0; Frame < FrameCount; Frame++)
+    {
+        ResetArena(TArena);
+        TraceLasers(Map, TArena);
+    }
+    
+    std::chrono::duration<f64> Elapsed = std::chrono::steady_clock::now() - Start;
+    
+    bench_result Result = {};
+    Result.Seconds = Elapsed.count();
+    Result.RaysCast = Map->LaserStats.RaysCast;
+    Result.Bounces = Map->LaserStats.Bounces;
+    
+    return Result;
+}
+
+static int
+RunKernelCheck(u32 RayCount, memory_arena* TArena)
+{
+    ray_kernel_check Check = CheckRaySegmentsKernels(RayCount, 1, TArena);
+    printf("%u rays against %u segments, %u hits, %u differ from TestRayIntersection\n", 
+           Check.Rays, Check.Segments, Check.Hits, Check.BaselineDifferences);
+    
+    char const* LevelNames[] = {"scalar", "sse2", "avx2"};
+    u32 Mismatches = 0;
+    for (u32 Level = Simd_SSE2; Level <= (u32)GlobalMaxSimdLevel; Level++)
+    {
+        printf("%s: %u mismatches\n", LevelNames[Level], Check.Mismatches[Level]);
+        Mismatches += Check.Mismatches[Level];
+    }
+    
+    return (Mismatches == 0) ? 0 : 1;
+}
+
+struct trace_config
+{
+    laser_trace_mode Mode;
+    bool Caching;
+    char const* Name;
+};
+
+//Moves every dynamic body the same way in every copy of a scene. Every fourth frame nothing moves, so the
+//cached modes get frames where every trace is reused as well as ones where only some are.
+static void
+MoveBodies(map_desc* Map, u32 Frame)
+{
+    physics_world* World = &Map->Physics;
+    if (Frame % 4 == 0)
+    {
+        return;
+    }
+    
+    for (u32 BodyIndex = 0; BodyIndex < World->BodyCount; BodyIndex++)
+    {
+        if (IsDynamic(World, BodyIndex))
+        {
+            f32 Angle = 0.7f * Frame + BodyIndex;
+            World->P[BodyIndex] += 0.004f * V2(cosf(Angle), sinf(Angle));
+        }
+    }
+}
+
+static bool
+TracesMatch(map_desc* Map, map_desc* Reference)
+{
+    if (Map->LaserBeams.Count != Reference->LaserBeams.Count ||
+        memcmp(Map->LaserBeams.Memory, Reference->LaserBeams.Memory, Map->LaserBeams.Count * sizeof(laser_beam)) != 0)
+    {
+        return false;
+    }
+    
+    for (u32 EntityIndex = 0; EntityIndex < Map->Entities.Count; EntityIndex++)
+    {
+        if (Map->Entities[EntityIndex].WasActivated != Reference->Entities[EntityIndex].WasActivated)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Runs the same scenes through every trace mode, with and without reusing traces, next to brute force without
+//reuse. Each frame's beams and activations have to match it exactly.
+static int
+RunTraceCheck(u32 FrameCount, memory_arena* SceneArena, memory_arena* ReferenceArena, memory_arena* MapArena, memory_arena* TArena)
+{
+    bench_scene Scenes[] = {{16, 8, 0, 8, 8}, {64, 64, 16, 16, 16}, {256, 8, 16, 32, 8}};
+    trace_config Configs[] = {
+        {LaserTrace_BVH, false, "bvh"}, {LaserTrace_BVH, true, "bvh cached"},
+        {LaserTrace_Grid, false, "grid"}, {LaserTrace_Grid, true, "grid cached"},
+    };
+    
+    u32 Mismatches = 0;
+    for (trace_config Config : Configs)
+    {
+        u32 ConfigMismatches = 0;
+        u64 Beams = 0;
+        u32 CacheHits = 0;
+        for (bench_scene Scene : Scenes)
+        {
+            ResetArena(SceneArena);
+            map_desc* Reference = CreateBenchmarkMap(SceneArena, Scene);
+            map_desc* Map = CreateBenchmarkMap(SceneArena, Scene);
+            CreateComponents(Reference, ReferenceArena);
+            CreateComponents(Map, MapArena);
+            
+            Reference->LaserMode = LaserTrace_BruteForce;
+            Reference->LaserCaching = false;
+            Map->LaserMode = Config.Mode;
+            Map->LaserCaching = Config.Caching;
+            
+            for (u32 Frame = 0; Frame < FrameCount; Frame++)
+            {
+                MoveBodies(Reference, Frame);
+                MoveBodies(Map, Frame);
+                
+                ResetArena(TArena);
+                TraceLasers(Reference, TArena);
+                TraceLasers(Map, TArena);
+                
+                ConfigMismatches += !TracesMatch(Map, Reference);
+                Beams += Map->LaserBeams.Count;
+            }
+            CacheHits += Map->LaserStats.CacheHits;
+        }
+        
+        printf("%s: %u frames, %llu beams, %u traces reused, %u mismatched frames\n", Config.Name, 
+               FrameCount * (u32)ArrayCount(Scenes), (unsigned long long)Beams, CacheHits, ConfigMismatches);
+        Mismatches += ConfigMismatches;
+    }
+    
+    return (Mismatches == 0) ? 0 : 1;
+}
+
+int main(int ArgCount, char** Args)
+{
+    GlobalMaxSimdLevel = DetectSimdLevel();
+    GlobalSimdLevel = GlobalMaxSimdLevel;
+    
+    if (ArgCount > 1 && strcmp(Args[1], "check") == 0)
+    {
+        memory_arena CheckArena = BenchCreateMemoryArena(Megabytes(16), TRANSIENT);
+        u32 RayCount = (ArgCount > 2) ? (u32)atoi(Args[2]) : 100000;
+        int KernelResult = RunKernelCheck(RayCount, &CheckArena);
+        
+        memory_arena SceneArena = BenchCreateMemoryArena(Megabytes(4), NORMAL);
+        memory_arena ReferenceArena = BenchCreateMemoryArena(Megabytes(16), NORMAL);
+        memory_arena MapArena = BenchCreateMemoryArena(Megabytes(16), NORMAL);
+        int TraceResult = RunTraceCheck(200, &SceneArena, &ReferenceArena, &MapArena, &CheckArena);
+        
+        return (KernelResult || TraceResult) ? 1 : 0;
+    }
+    
+    char* OutputPath = (ArgCount > 1) ? Args[1] : 0;
+    u32 FrameCount = (ArgCount > 2) ? (u32)atoi(Args[2]) : 240;
+    
+    FILE* Output = OutputPath ? fopen(OutputPath, "w") : stdout;
+    if (!Output)
+    {
+        fprintf(stderr, "Could not open %s\n", OutputPath);
+        return -1;
+    }
+    
+    memory_arena SceneArena = BenchCreateMemoryArena(Megabytes(16), NORMAL);
+    memory_arena MapArena = BenchCreateMemoryArena(Megabytes(64), NORMAL);
+    memory_arena TransientArena = BenchCreateMemoryArena(Megabytes(16), TRANSIENT);
+    
+    u32 ReflectorCounts[] = {16, 64, 256, 1024};
+    u32 LaserCounts[] = {1, 8, 64};
+    u32 WindowCounts[] = {0, 16, 128};
+    
+    laser_trace_mode Modes[] = {LaserTrace_BVH, LaserTrace_Grid};
+    char const* ModeNames[] = {"bvh", "grid"};
+    
+    fprintf(Output, "reflectors,lasers,windows,mode,frames,rays,bounces,frame_ms,ns_per_ray,ns_per_bounce\n");
+    
+    for (u32 ReflectorCount : ReflectorCounts)
+    {
+        for (u32 LaserCount : LaserCounts)
+        {
+            for (u32 WindowCount : WindowCounts)
+            {
+                for (u32 ModeIndex = 0; ModeIndex < ArrayCount(Modes); ModeIndex++)
+                {
+                    bench_scene Scene = {ReflectorCount, LaserCount, WindowCount};
+                    bench_result Result = RunBenchmark(Scene, Modes[ModeIndex], FrameCount, &SceneArena, &MapArena, &TransientArena);
+                    
+                    f64 Nanoseconds = Result.Seconds * 1e9;
+                    f64 FrameMs = (FrameCount > 0) ? Result.Seconds * 1e3 / FrameCount : 0.0;
+                    f64 NsPerRay = Result.RaysCast ? Nanoseconds / Result.RaysCast : 0.0;
+                    f64 NsPerBounce = Result.Bounces ? Nanoseconds / Result.Bounces : 0.0;
+                    
+                    fprintf(Output, "%u,%u,%u,%s,%u,%llu,%llu,%.4f,%.1f,%.1f\n",
+                            ReflectorCount, LaserCount, WindowCount, ModeNames[ModeIndex], FrameCount,
+                            (unsigned long long)Result.RaysCast, (unsigned long long)Result.Bounces, FrameMs, NsPerRay, NsPerBounce);
+                    fflush(Output);
+                }
+            }
+        }
+    }
+    
+    if (Output != stdout)
+    {
+        fclose(Output);
+    }
+    
+    return 0;
+}
+
+void BenchDebugOut(string String)
+{
+    fprintf(stderr, "%.*s", (int)String.Length, String.Text);
+}
+
+void BenchSleep(int Milliseconds)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(Milliseconds));
+}
+
+span<u8>
+BenchLoadFile(memory_arena* Arena, char* Path)
+{
+    span<u8> Result = {}; //No maps are loaded, every scene is generated
+    return Result;
+}
+
+void
+BenchSaveFile(char* Path, span<u8> Data)
+{
+}
+
+f32 BenchTextWidth(string String, f32 FontSize)
+{
+    return 0.0f;
+}
+
+void BenchAddWork(work_queue* Queue, work_queue_callback* Callback, void* Data)
+{
+    Callback(Data);
+}
+
+void BenchCompleteAllWork(work_queue* Queue)
+{
+}
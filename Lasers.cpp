@@ -0,0 +1,1316 @@
+static u32
+GetColorOfEntity(map_desc* Map, u32 EntityIndex)
+{
+    u32 Result = 0;
+    
+    entity* Entity = Map->Entities + EntityIndex;
+    if (Entity->RigidBodyIndex)
+    {
+        Result = Map->RigidBodies[Entity->RigidBodyIndex].Color;
+    }
+    else if (Entity->LineIndex)
+    {
+        Result = Map->Lines[Entity->LineIndex].Color;
+    }
+    else if (Entity->LaserIndex)
+    {
+        Result = Map->Lasers[Entity->LaserIndex].Color;
+    }
+    
+    return Result;
+}
+
+static void
+BuildEntityColors(map_desc* Map, memory_arena* Arena)
+{
+    Map->EntityColors = AllocSpan(Arena, entity_color, Map->Entities.Count);
+    for (u32 EntityIndex = 0; EntityIndex < Map->Entities.Count; EntityIndex++)
+    {
+        entity_color* EntityColor = Map->EntityColors + EntityIndex;
+        EntityColor->Color = GetColorOfEntity(Map, EntityIndex);
+        EntityColor->Filter = 0xFFFFFFFF;
+        
+        u32 BodyIndex = Map->Entities[EntityIndex].RigidBodyIndex;
+        if (BodyIndex && Map->RigidBodies[BodyIndex].Translucent)
+        {
+            EntityColor->Filter = Map->RigidBodies[BodyIndex].Color;
+        }
+    }
+}
+
+//Each channel of A limited to the same channel of B
+static inline u32
+PackedMinU8(u32 A, u32 B)
+{
+    u32 Result = (u32)_mm_cvtsi128_si32(_mm_min_epu8(_mm_cvtsi32_si128((int)A), _mm_cvtsi32_si128((int)B)));
+    return Result;
+}
+
+struct ray_collision
+{
+    bool DidHit;
+    v2 P;
+    v2 Normal;
+    f32 t;
+};
+
+//The behavioural baseline. Lasers solve the same system with SolveRaySegment(), which rounds differently.
+static ray_collision
+TestRayIntersection(v2 P, v2 Direction, line_segment Wall)
+{
+    f32 Epsilon = 0.00001f;
+    v2 WallDirection = Wall.End - Wall.Start;
+    
+    v2 st = Inverse(M2x2(WallDirection, -1.0f * Direction)) * (P - Wall.Start);
+    f32 s = st.X;
+    f32 t = st.Y;
+    
+    ray_collision Result = {};
+    Result.DidHit = (s >= 0.0f && s <= 1.0f) && (t > 0.0f);
+    if (Result.DidHit)
+    {
+        Result.P = P + t * Direction - Epsilon * UnitV(Direction);
+        Result.Normal = Direction - DotProduct(Direction, UnitV(WallDirection)) * UnitV(WallDirection); //TODO : Make a projection function
+        Result.t = t;
+    }
+    return Result;
+}
+
+struct ray_segment_solution
+{
+    f32 s; //Along the segment, 0 to 1 is on it
+    f32 t; //Along the ray
+};
+
+//TestRayIntersection()'s P + t * Direction = Start + s * Edge, with one reciprocal of Cross(Direction, Edge)
+//and two cross products instead of a matrix inverse. Parallel edges give an infinite or NaN s, which never
+//counts as a hit. The ray kernels repeat these operations in the same order, so they match it bit for bit.
+static inline ray_segment_solution
+SolveRaySegment(v2 P, v2 Direction, v2 WallStart, v2 WallDirection)
+{
+    v2 FromWall = P - WallStart;
+    f32 InverseDenom = 1.0f / CrossProduct(Direction, WallDirection);
+    
+    ray_segment_solution Result = {};
+    Result.s = CrossProduct(Direction, FromWall) * InverseDenom;
+    Result.t = CrossProduct(WallDirection, FromWall) * InverseDenom;
+    return Result;
+}
+
+static inline bool
+IsRaySegmentHit(ray_segment_solution Solution, f32 MaxT)
+{
+    bool Result = (Solution.s >= 0.0f && Solution.s <= 1.0f) && (Solution.t > 0.0f) && (Solution.t <= MaxT);
+    return Result;
+}
+
+//The hit TestRayIntersection() makes, for a t from SolveRaySegment() or one of the kernels
+static inline ray_collision
+RayCollisionAt(v2 P, v2 Direction, v2 WallDirection, f32 t)
+{
+    f32 Epsilon = 0.00001f;
+    
+    ray_collision Result = {};
+    Result.DidHit = true;
+    Result.P = P + t * Direction - Epsilon * UnitV(Direction);
+    Result.Normal = Direction - DotProduct(Direction, UnitV(WallDirection)) * UnitV(WallDirection); //TODO : Make a projection function
+    Result.t = t;
+    return Result;
+}
+
+//
+//----------Laser BVH----------
+//
+
+f32 const LaserBoundsPadding = 0.001f; //Covers rounding between the slab test and SolveRaySegment()
+f32 const MaxLaserDistance = 100.0f;
+u32 const MaxOccludersPerLeaf = 4;
+
+static rect
+OccluderBoundsOf(map_desc* Map, laser_occluder Occluder)
+{
+    rect Result = {};
+    if (Occluder.Type == Occluder_Line)
+    {
+        line* Line = Map->Lines + Occluder.Index;
+        v2 End = Line->Start + Line->Offset;
+        Result.MinCorner = V2(Min(Line->Start.X, End.X), Min(Line->Start.Y, End.Y));
+        Result.MaxCorner = V2(Max(Line->Start.X, End.X), Max(Line->Start.Y, End.Y));
+    }
+    else
+    {
+        Result = RectOf(&Map->Physics, Occluder.Index);
+    }
+    
+    Result.MinCorner -= V2(LaserBoundsPadding, LaserBoundsPadding);
+    Result.MaxCorner += V2(LaserBoundsPadding, LaserBoundsPadding);
+    return Result;
+}
+
+//Every path that tests a ray against an occluder goes through these edges, so they all agree bit for bit
+static u32
+OccluderEdges(map_desc* Map, laser_occluder Occluder, line_segment* Edges)
+{
+    u32 Result = 0;
+    if (Occluder.Type == Occluder_Line)
+    {
+        line* Line = Map->Lines + Occluder.Index;
+        Edges[Result++] = {Line->Start, Line->Start + Line->Offset};
+    }
+    else
+    {
+        rect Rect = RectOf(&Map->Physics, Occluder.Index);
+        v2 MinCorner = Rect.MinCorner;
+        v2 MaxCorner = Rect.MaxCorner;
+        
+        Edges[Result++] = {MinCorner, V2(MaxCorner.X, MinCorner.Y)};
+        Edges[Result++] = {MinCorner, V2(MinCorner.X, MaxCorner.Y)};
+        Edges[Result++] = {MaxCorner, V2(MinCorner.X, MaxCorner.Y)};
+        Edges[Result++] = {MaxCorner, V2(MaxCorner.X, MinCorner.Y)};
+    }
+    return Result;
+}
+
+static inline u32
+EdgeCountOf(laser_occluder Occluder)
+{
+    u32 Result = (Occluder.Type == Occluder_Line) ? 1 : 4;
+    return Result;
+}
+
+//Returns whether any of the occluder's edges changed
+static bool
+UpdateOccluderSegments(map_desc* Map, laser_bvh* BVH, u32 OccluderIndex)
+{
+    laser_segments* Segments = &BVH->Segments;
+    
+    line_segment Edges[4];
+    u32 EdgeCount = OccluderEdges(Map, BVH->Occluders[OccluderIndex], Edges);
+    Assert(BVH->FirstSegment[OccluderIndex] + EdgeCount == BVH->FirstSegment[OccluderIndex + 1]);
+    
+    bool Changed = false;
+    for (u32 EdgeIndex = 0; EdgeIndex < EdgeCount; EdgeIndex++)
+    {
+        u32 Segment = BVH->FirstSegment[OccluderIndex] + EdgeIndex;
+        v2 Start = Edges[EdgeIndex].Start;
+        v2 Edge = Edges[EdgeIndex].End - Edges[EdgeIndex].Start;
+        
+        Changed |= (Segments->StartX[Segment] != Start.X || Segments->StartY[Segment] != Start.Y || 
+                    Segments->EdgeX[Segment] != Edge.X || Segments->EdgeY[Segment] != Edge.Y);
+        
+        Segments->StartX[Segment] = Start.X;
+        Segments->StartY[Segment] = Start.Y;
+        Segments->EdgeX[Segment] = Edge.X;
+        Segments->EdgeY[Segment] = Edge.Y;
+        Segments->Occluder[Segment] = OccluderIndex;
+    }
+    return Changed;
+}
+
+static inline rect
+RectUnion(rect A, rect B)
+{
+    rect Result = {};
+    Result.MinCorner = V2(Min(A.MinCorner.X, B.MinCorner.X), Min(A.MinCorner.Y, B.MinCorner.Y));
+    Result.MaxCorner = V2(Max(A.MaxCorner.X, B.MaxCorner.X), Max(A.MaxCorner.Y, B.MaxCorner.Y));
+    return Result;
+}
+
+static rect
+OccluderBoundsUnion(laser_bvh* BVH, u32 First, u32 Count)
+{
+    rect Result = BVH->OccluderBounds[First];
+    for (u32 Index = First + 1; Index < First + Count; Index++)
+    {
+        Result = RectUnion(Result, BVH->OccluderBounds[Index]);
+    }
+    return Result;
+}
+
+struct laser_bvh_build_entry
+{
+    f32 Key;
+    laser_occluder Occluder;
+    rect Bounds;
+};
+
+static int
+CompareBuildEntries(const void* A, const void* B)
+{
+    f32 KeyA = ((laser_bvh_build_entry*)A)->Key;
+    f32 KeyB = ((laser_bvh_build_entry*)B)->Key;
+    
+    int Result = (KeyA > KeyB) - (KeyA < KeyB);
+    return Result;
+}
+
+//Splits at the median centroid along the longer side, so the tree stays balanced whatever the layout
+static void
+SplitLaserBVHNode(laser_bvh* BVH, laser_bvh_build_entry* Entries, u32 NodeIndex)
+{
+    laser_bvh_node* Node = BVH->Nodes + NodeIndex;
+    
+    rect Bounds = Entries[Node->First].Bounds;
+    for (u32 Index = Node->First + 1; Index < Node->First + Node->Count; Index++)
+    {
+        Bounds = RectUnion(Bounds, Entries[Index].Bounds);
+    }
+    Node->Bounds = Bounds;
+    
+    if (Node->Count <= MaxOccludersPerLeaf)
+    {
+        return;
+    }
+    
+    v2 Size = Bounds.MaxCorner - Bounds.MinCorner;
+    bool SplitX = (Size.X >= Size.Y);
+    for (u32 Index = Node->First; Index < Node->First + Node->Count; Index++)
+    {
+        rect EntryBounds = Entries[Index].Bounds;
+        Entries[Index].Key = SplitX ? (EntryBounds.MinCorner.X + EntryBounds.MaxCorner.X) : (EntryBounds.MinCorner.Y + EntryBounds.MaxCorner.Y);
+    }
+    qsort(Entries + Node->First, Node->Count, sizeof(laser_bvh_build_entry), CompareBuildEntries);
+    
+    u32 LeftCount = Node->Count / 2;
+    u32 Left = BVH->NodeCount;
+    BVH->NodeCount += 2;
+    Assert(BVH->NodeCount <= BVH->Nodes.Count);
+    
+    BVH->Nodes[Left].First = Node->First;
+    BVH->Nodes[Left].Count = LeftCount;
+    BVH->Nodes[Left + 1].First = Node->First + LeftCount;
+    BVH->Nodes[Left + 1].Count = Node->Count - LeftCount;
+    
+    Node->First = Left;
+    Node->Count = 0;
+    
+    SplitLaserBVHNode(BVH, Entries, Left);
+    SplitLaserBVHNode(BVH, Entries, Left + 1);
+}
+
+static void
+BuildLaserBVH(map_desc* Map, memory_arena* Arena)
+{
+    u32 OccluderCount = Map->Lines.Count + Map->RigidBodies.Count;
+    
+    laser_bvh BVH = {};
+    BVH.Occluders = AllocSpan(Arena, laser_occluder, OccluderCount);
+    BVH.OccluderBounds = AllocSpan(Arena, rect, OccluderCount);
+    BVH.Nodes = AllocSpan(Arena, laser_bvh_node, 2 * OccluderCount);
+    
+    if (OccluderCount > 0)
+    {
+        //The entries are only needed while building, but the map arena is all there is here
+        laser_bvh_build_entry* Entries = AllocArray(Arena, laser_bvh_build_entry, OccluderCount);
+        u32 EntryCount = 0;
+        for (u32 LineIndex = 0; LineIndex < Map->Lines.Count; LineIndex++)
+        {
+            Entries[EntryCount].Occluder = {Occluder_Line, LineIndex};
+            Entries[EntryCount].Bounds = OccluderBoundsOf(Map, Entries[EntryCount].Occluder);
+            EntryCount++;
+        }
+        for (u32 BodyIndex = 0; BodyIndex < Map->RigidBodies.Count; BodyIndex++)
+        {
+            Entries[EntryCount].Occluder = {Occluder_Body, BodyIndex};
+            Entries[EntryCount].Bounds = OccluderBoundsOf(Map, Entries[EntryCount].Occluder);
+            EntryCount++;
+        }
+        
+        BVH.NodeCount = 1;
+        BVH.Nodes[0].First = 0;
+        BVH.Nodes[0].Count = OccluderCount;
+        SplitLaserBVHNode(&BVH, Entries, 0);
+        
+        for (u32 Index = 0; Index < OccluderCount; Index++)
+        {
+            BVH.Occluders[Index] = Entries[Index].Occluder;
+            BVH.OccluderBounds[Index] = Entries[Index].Bounds;
+        }
+    }
+    
+    BVH.FirstSegment = AllocSpan(Arena, u32, OccluderCount + 1);
+    u32 SegmentCount = 0;
+    for (u32 Index = 0; Index < OccluderCount; Index++)
+    {
+        BVH.FirstSegment[Index] = SegmentCount;
+        SegmentCount += EdgeCountOf(BVH.Occluders[Index]);
+    }
+    BVH.FirstSegment[OccluderCount] = SegmentCount;
+    
+    BVH.Segments.Count = SegmentCount;
+    BVH.Segments.StartX = AllocArray(Arena, f32, SegmentCount + 7);
+    BVH.Segments.StartY = AllocArray(Arena, f32, SegmentCount + 7);
+    BVH.Segments.EdgeX = AllocArray(Arena, f32, SegmentCount + 7);
+    BVH.Segments.EdgeY = AllocArray(Arena, f32, SegmentCount + 7);
+    BVH.Segments.Occluder = AllocArray(Arena, u32, SegmentCount + 7);
+    for (u32 Index = 0; Index < OccluderCount; Index++)
+    {
+        UpdateOccluderSegments(Map, &BVH, Index);
+    }
+    
+    Map->LaserBVH = BVH;
+}
+
+//The tree's shape is kept and only its bounds are updated. Bodies don't travel far within a level, so
+//that stays a good enough tree. Returns the area each occluder that moved covered before and after.
+//A line can turn inside the same bounds, so the edges are compared as well.
+static span<rect>
+RefitLaserBVH(map_desc* Map, memory_arena* TArena)
+{
+    laser_bvh* BVH = &Map->LaserBVH;
+    
+    span<rect> Moved = BeginSpan<rect>(TArena);
+    for (u32 Index = 0; Index < BVH->Occluders.Count; Index++)
+    {
+        rect Bounds = OccluderBoundsOf(Map, BVH->Occluders[Index]);
+        bool EdgesChanged = UpdateOccluderSegments(Map, BVH, Index);
+        if (EdgesChanged || memcmp(&Bounds, &BVH->OccluderBounds[Index], sizeof(rect)) != 0)
+        {
+            *AllocStruct(TArena, rect) = RectUnion(Bounds, BVH->OccluderBounds[Index]);
+            BVH->OccluderBounds[Index] = Bounds;
+        }
+    }
+    EndSpan(Moved, TArena);
+    
+    if (Moved.Count == 0)
+    {
+        return Moved;
+    }
+    
+    for (u32 NodeIndex = BVH->NodeCount; NodeIndex-- > 0;)
+    {
+        laser_bvh_node* Node = BVH->Nodes + NodeIndex;
+        if (Node->Count)
+        {
+            Node->Bounds = OccluderBoundsUnion(BVH, Node->First, Node->Count);
+        }
+        else
+        {
+            Node->Bounds = RectUnion(BVH->Nodes[Node->First].Bounds, BVH->Nodes[Node->First + 1].Bounds);
+        }
+    }
+    
+    return Moved;
+}
+
+//Slab test, gives where the ray enters and leaves Bounds if it enters before MaxT
+static bool
+RayBoundsInterval(v2 P, v2 Direction, rect Bounds, f32 MaxT, f32* EntryT, f32* ExitT)
+{
+    f32 Starts[] = {P.X, P.Y};
+    f32 Directions[] = {Direction.X, Direction.Y};
+    f32 Mins[] = {Bounds.MinCorner.X, Bounds.MinCorner.Y};
+    f32 Maxs[] = {Bounds.MaxCorner.X, Bounds.MaxCorner.Y};
+    
+    f32 Enter = 0.0f;
+    f32 Exit = MaxT;
+    for (u32 Axis = 0; Axis < 2; Axis++)
+    {
+        if (Directions[Axis] == 0.0f)
+        {
+            if (Starts[Axis] < Mins[Axis] || Starts[Axis] > Maxs[Axis])
+            {
+                return false;
+            }
+            continue;
+        }
+        
+        f32 TimeToMin = (Mins[Axis] - Starts[Axis]) / Directions[Axis];
+        f32 TimeToMax = (Maxs[Axis] - Starts[Axis]) / Directions[Axis];
+        Enter = Max(Enter, Min(TimeToMin, TimeToMax));
+        Exit = Min(Exit, Max(TimeToMin, TimeToMax));
+    }
+    
+    *EntryT = Enter;
+    *ExitT = Exit;
+    return (Enter <= Exit);
+}
+
+static inline bool
+RayHitsBounds(v2 P, v2 Direction, rect Bounds, f32 MaxT, f32* EntryT)
+{
+    f32 ExitT;
+    bool Result = RayBoundsInterval(P, Direction, Bounds, MaxT, EntryT, &ExitT);
+    return Result;
+}
+
+struct laser_hit
+{
+    ray_collision Collision;
+    u64 Key; //Occluder type then index, ties between equally near hits go to the lowest key
+    u32 EntityIndex;
+    bool Reflective;
+    bool Translucent;
+};
+
+static inline bool
+IsNearerHit(f32 t, u64 Key, laser_hit* Nearest)
+{
+    bool Result = (t < Nearest->Collision.t || 
+                   (t == Nearest->Collision.t && Nearest->Collision.DidHit && Key < Nearest->Key));
+    return Result;
+}
+
+static inline u64
+OccluderKey(laser_occluder Occluder)
+{
+    u64 Result = ((u64)Occluder.Type << 32) | Occluder.Index;
+    return Result;
+}
+
+static void
+SetNearestHit(map_desc* Map, laser_occluder Occluder, ray_collision Collision, laser_hit* Nearest)
+{
+    Nearest->Collision = Collision;
+    Nearest->Key = OccluderKey(Occluder);
+    if (Occluder.Type == Occluder_Line)
+    {
+        line* Line = Map->Lines + Occluder.Index;
+        Nearest->EntityIndex = Line->EntityIndex;
+        Nearest->Reflective = Line->Reflective;
+        Nearest->Translucent = false;
+    }
+    else
+    {
+        rigid_body* RigidBody = Map->RigidBodies + Occluder.Index;
+        Nearest->EntityIndex = RigidBody->EntityIndex;
+        Nearest->Reflective = false;
+        Nearest->Translucent = RigidBody->Translucent;
+    }
+}
+
+//Keeps the nearest hit, preferring lines to bodies and lower indices at equal distances like one pass over
+//every line and then every body would. This is the scalar reference the SIMD kernels are checked against.
+static inline void
+TestOccluder(map_desc* Map, laser_occluder Occluder, v2 P, v2 Direction, laser_hit* Nearest)
+{
+    u64 Key = OccluderKey(Occluder);
+    
+    line_segment Edges[4];
+    u32 EdgeCount = OccluderEdges(Map, Occluder, Edges);
+    for (u32 EdgeIndex = 0; EdgeIndex < EdgeCount; EdgeIndex++)
+    {
+        //The same subtraction as UpdateOccluderSegments(), so the kernels see the same edge
+        v2 WallDirection = Edges[EdgeIndex].End - Edges[EdgeIndex].Start;
+        ray_segment_solution Solution = SolveRaySegment(P, Direction, Edges[EdgeIndex].Start, WallDirection);
+        
+        if (IsRaySegmentHit(Solution, Nearest->Collision.t) && IsNearerHit(Solution.t, Key, Nearest))
+        {
+            SetNearestHit(Map, Occluder, RayCollisionAt(P, Direction, WallDirection, Solution.t), Nearest);
+        }
+    }
+}
+
+//
+//Ray against segment kernels. Each tests one ray against up to 8 segments of the SoA from Index on and
+//returns a mask of those hit no farther than MaxT, with where along the ray in OutT. They all repeat
+//SolveRaySegment(): one division per lane, for the reciprocal of Cross(Direction, Edge).
+//
+
+static int
+RaySegmentsScalar(laser_segments* Segments, u32 Index, u32 Count, v2 P, v2 Direction, f32 MaxT, f32* OutT)
+{
+    int Mask = 0;
+    for (u32 Lane = 0; Lane < Count; Lane++)
+    {
+        u32 Segment = Index + Lane;
+        v2 WallStart = V2(Segments->StartX[Segment], Segments->StartY[Segment]);
+        v2 WallDirection = V2(Segments->EdgeX[Segment], Segments->EdgeY[Segment]);
+        
+        ray_segment_solution Solution = SolveRaySegment(P, Direction, WallStart, WallDirection);
+        
+        OutT[Lane] = Solution.t;
+        if (IsRaySegmentHit(Solution, MaxT))
+        {
+            Mask |= (1 << Lane);
+        }
+    }
+    return Mask;
+}
+
+static int
+RaySegmentsSSE2(laser_segments* Segments, u32 Index, u32 Count, v2 P, v2 Direction, f32 MaxT, f32* OutT)
+{
+    __m128 PX = _mm_set1_ps(P.X);
+    __m128 PY = _mm_set1_ps(P.Y);
+    __m128 DirectionX = _mm_set1_ps(Direction.X);
+    __m128 DirectionY = _mm_set1_ps(Direction.Y);
+    __m128 Zero = _mm_setzero_ps();
+    __m128 One = _mm_set1_ps(1.0f);
+    __m128 MaxTs = _mm_set1_ps(MaxT);
+    
+    int Mask = 0;
+    for (u32 Half = 0; Half < 2; Half++)
+    {
+        u32 Segment = Index + 4 * Half;
+        __m128 EdgeX = _mm_loadu_ps(Segments->EdgeX + Segment);
+        __m128 EdgeY = _mm_loadu_ps(Segments->EdgeY + Segment);
+        __m128 FromWallX = _mm_sub_ps(PX, _mm_loadu_ps(Segments->StartX + Segment));
+        __m128 FromWallY = _mm_sub_ps(PY, _mm_loadu_ps(Segments->StartY + Segment));
+        
+        //A true division, a _mm_rcp_ps estimate wouldn't match the scalar kernel
+        __m128 Denom = _mm_sub_ps(_mm_mul_ps(DirectionX, EdgeY), _mm_mul_ps(DirectionY, EdgeX));
+        __m128 InverseDenom = _mm_div_ps(One, Denom);
+        
+        __m128 s = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(DirectionX, FromWallY), _mm_mul_ps(DirectionY, FromWallX)), InverseDenom);
+        __m128 t = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(EdgeX, FromWallY), _mm_mul_ps(EdgeY, FromWallX)), InverseDenom);
+        
+        __m128 Hit = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(s, Zero), _mm_cmple_ps(s, One)),
+                                _mm_and_ps(_mm_cmpgt_ps(t, Zero), _mm_cmple_ps(t, MaxTs)));
+        _mm_storeu_ps(OutT + 4 * Half, t);
+        Mask |= _mm_movemask_ps(Hit) << (4 * Half);
+    }
+    
+    Mask &= (1 << Count) - 1;
+    return Mask;
+}
+
+TARGET_AVX2 static int
+RaySegmentsAVX2(laser_segments* Segments, u32 Index, u32 Count, v2 P, v2 Direction, f32 MaxT, f32* OutT)
+{
+    __m256 DirectionX = _mm256_set1_ps(Direction.X);
+    __m256 DirectionY = _mm256_set1_ps(Direction.Y);
+    __m256 Zero = _mm256_setzero_ps();
+    __m256 One = _mm256_set1_ps(1.0f);
+    
+    __m256 EdgeX = _mm256_loadu_ps(Segments->EdgeX + Index);
+    __m256 EdgeY = _mm256_loadu_ps(Segments->EdgeY + Index);
+    __m256 FromWallX = _mm256_sub_ps(_mm256_set1_ps(P.X), _mm256_loadu_ps(Segments->StartX + Index));
+    __m256 FromWallY = _mm256_sub_ps(_mm256_set1_ps(P.Y), _mm256_loadu_ps(Segments->StartY + Index));
+    
+    //No FMAs, they would round differently from the scalar reference
+    __m256 Denom = _mm256_sub_ps(_mm256_mul_ps(DirectionX, EdgeY), _mm256_mul_ps(DirectionY, EdgeX));
+    __m256 InverseDenom = _mm256_div_ps(One, Denom);
+    
+    __m256 s = _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(DirectionX, FromWallY), _mm256_mul_ps(DirectionY, FromWallX)), InverseDenom);
+    __m256 t = _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(EdgeX, FromWallY), _mm256_mul_ps(EdgeY, FromWallX)), InverseDenom);
+    
+    __m256 Hit = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(s, Zero, _CMP_GE_OQ), _mm256_cmp_ps(s, One, _CMP_LE_OQ)),
+                               _mm256_and_ps(_mm256_cmp_ps(t, Zero, _CMP_GT_OQ), _mm256_cmp_ps(t, _mm256_set1_ps(MaxT), _CMP_LE_OQ)));
+    _mm256_storeu_ps(OutT, t);
+    
+    int Mask = _mm256_movemask_ps(Hit) & ((1 << Count) - 1);
+    return Mask;
+}
+
+typedef int ray_segments_kernel(laser_segments* Segments, u32 Index, u32 Count, v2 P, v2 Direction, f32 MaxT, f32* OutT);
+
+static ray_segments_kernel*
+GetRaySegmentsKernel(simd_level Level)
+{
+    ray_segments_kernel* Result = 0;
+    switch (Level)
+    {
+        case Simd_Scalar: Result = RaySegmentsScalar; break;
+        case Simd_SSE2:   Result = RaySegmentsSSE2; break;
+        case Simd_AVX2:   Result = RaySegmentsAVX2; break;
+        default: Assert(0);
+    }
+    return Result;
+}
+
+struct ray_kernel_check
+{
+    u32 Rays;
+    u32 Segments;
+    u32 Hits; //Lanes the scalar kernel hit
+    u32 Mismatches[3]; //For each wide simd_level, lanes whose hit or t differ from the scalar kernel
+    u32 BaselineDifferences; //Lanes where the scalar kernel's hit differs from TestRayIntersection() or t by more than rounding
+};
+
+//Sweeps random rays over random segments through every kernel this CPU can run and compares each lane
+//with the scalar kernel bit for bit, and the scalar kernel with TestRayIntersection() up to rounding.
+//Body-like axis aligned edges, zero length edges, rays aimed straight at an end and batches shorter than 8
+//are mixed in. Rays aimed at an end can round onto either side of it, so they aren't held to the baseline.
+static ray_kernel_check
+CheckRaySegmentsKernels(u32 RayCount, u32 Seed, memory_arena* TArena)
+{
+    temporary_memory CheckMemory = BeginTemporaryMemory(TArena);
+    srand(Seed);
+    
+    u32 const SegmentCount = 64;
+    line_segment* Walls = AllocArray(TArena, line_segment, SegmentCount);
+    
+    laser_segments Segments = {};
+    Segments.Count = SegmentCount;
+    Segments.StartX = AllocArray(TArena, f32, SegmentCount + 7);
+    Segments.StartY = AllocArray(TArena, f32, SegmentCount + 7);
+    Segments.EdgeX = AllocArray(TArena, f32, SegmentCount + 7);
+    Segments.EdgeY = AllocArray(TArena, f32, SegmentCount + 7);
+    
+    for (u32 Segment = 0; Segment < SegmentCount + 7; Segment++)
+    {
+        v2 Start = V2(RandomBetween(0.0f, 1.0f), RandomBetween(0.0f, ScreenTop));
+        v2 End = Start + V2(RandomBetween(-0.2f, 0.2f), RandomBetween(-0.2f, 0.2f));
+        switch (Segment % 8)
+        {
+            case 0: End = Start; break;
+            case 1: case 2: End.Y = Start.Y; break;
+            case 3: case 4: End.X = Start.X; break;
+        }
+        
+        //The same subtraction as UpdateOccluderSegments() and TestOccluder()
+        v2 Edge = End - Start;
+        Segments.StartX[Segment] = Start.X;
+        Segments.StartY[Segment] = Start.Y;
+        Segments.EdgeX[Segment] = Edge.X;
+        Segments.EdgeY[Segment] = Edge.Y;
+        
+        if (Segment < SegmentCount)
+        {
+            Walls[Segment] = {Start, End};
+        }
+    }
+    
+    ray_kernel_check Result = {};
+    Result.Segments = SegmentCount;
+    
+    for (u32 Ray = 0; Ray < RayCount; Ray++)
+    {
+        v2 P = V2(RandomBetween(0.0f, 1.0f), RandomBetween(0.0f, ScreenTop));
+        f32 Angle = RandomBetween(0.0f, 2.0f * 3.14159265f);
+        v2 Direction = V2(cosf(Angle), sinf(Angle));
+        if (Ray % 4 == 0)
+        {
+            line_segment Wall = Walls[rand() % SegmentCount];
+            Direction = UnitV(((Ray % 8) ? Wall.Start : Wall.End) - P);
+        }
+        f32 MaxT = RandomBetween(0.1f, 2.0f);
+        
+        for (u32 Index = 0; Index < SegmentCount; Index += 8)
+        {
+            u32 Count = (Ray % 2) ? 1 + rand() % 8 : 8;
+            
+            f32 ExpectedT[8];
+            int ExpectedMask = RaySegmentsScalar(&Segments, Index, Count, P, Direction, MaxT, ExpectedT);
+            for (u32 Lane = 0; Lane < Count; Lane++)
+            {
+                bool ExpectedHit = (ExpectedMask & (1 << Lane)) != 0;
+                Result.Hits += ExpectedHit;
+                
+                ray_collision Baseline = TestRayIntersection(P, Direction, Walls[Index + Lane]);
+                bool BaselineHit = Baseline.DidHit && Baseline.t <= MaxT;
+                bool AimedAtEnd = (Ray % 4 == 0);
+                if (!AimedAtEnd && 
+                    (BaselineHit != ExpectedHit || (ExpectedHit && fabsf(Baseline.t - ExpectedT[Lane]) > 0.0001f * Baseline.t)))
+                {
+                    Result.BaselineDifferences++;
+                }
+            }
+            
+            for (u32 Level = Simd_SSE2; Level <= (u32)GlobalMaxSimdLevel; Level++)
+            {
+                f32 T[8];
+                int Mask = GetRaySegmentsKernel((simd_level)Level)(&Segments, Index, Count, P, Direction, MaxT, T);
+                for (u32 Lane = 0; Lane < Count; Lane++)
+                {
+                    bool Hit = (Mask & (1 << Lane)) != 0;
+                    bool ExpectedHit = (ExpectedMask & (1 << Lane)) != 0;
+                    if (Hit != ExpectedHit || (Hit && memcmp(T + Lane, ExpectedT + Lane, sizeof(f32)) != 0))
+                    {
+                        Result.Mismatches[Level]++;
+                    }
+                }
+            }
+        }
+        
+        Result.Rays++;
+    }
+    
+    EndTemporaryMemory(CheckMemory);
+    return Result;
+}
+
+//Tests every edge in a leaf, 8 at a time. Batches where nothing is nearer than the current hit are skipped
+//without looking at a single lane.
+static void
+TestLeafSegments(map_desc* Map, ray_segments_kernel* Kernel, laser_bvh_node* Leaf, v2 P, v2 Direction, laser_hit* Nearest)
+{
+    laser_bvh* BVH = &Map->LaserBVH;
+    laser_segments* Segments = &BVH->Segments;
+    
+    u32 OnePastLast = BVH->FirstSegment[Leaf->First + Leaf->Count];
+    for (u32 Index = BVH->FirstSegment[Leaf->First]; Index < OnePastLast; Index += 8)
+    {
+        u32 Count = (OnePastLast - Index < 8) ? (OnePastLast - Index) : 8;
+        
+        f32 T[8];
+        int Mask = Kernel(Segments, Index, Count, P, Direction, Nearest->Collision.t, T);
+        
+#if DEBUG
+        if (Kernel != RaySegmentsScalar)
+        {
+            f32 ExpectedT[8];
+            int ExpectedMask = RaySegmentsScalar(Segments, Index, Count, P, Direction, Nearest->Collision.t, ExpectedT);
+            Assert(Mask == ExpectedMask);
+            for (u32 Lane = 0; Lane < Count; Lane++)
+            {
+                Assert(!(Mask & (1 << Lane)) || memcmp(T + Lane, ExpectedT + Lane, sizeof(f32)) == 0);
+            }
+        }
+#endif
+        
+        //Lanes go in segment order, so a body's first edge wins a tie with its others like in TestOccluder()
+        for (u32 Lane = 0; Mask; Lane++, Mask >>= 1)
+        {
+            if (Mask & 1)
+            {
+                u32 Segment = Index + Lane;
+                laser_occluder Occluder = BVH->Occluders[Segments->Occluder[Segment]];
+                if (IsNearerHit(T[Lane], OccluderKey(Occluder), Nearest))
+                {
+                    ray_collision Collision = RayCollisionAt(P, Direction, V2(Segments->EdgeX[Segment], Segments->EdgeY[Segment]), T[Lane]);
+                    SetNearestHit(Map, Occluder, Collision, Nearest);
+                }
+            }
+        }
+    }
+}
+
+static laser_hit
+FindNearestLaserHitBruteForce(map_desc* Map, v2 P, v2 Direction)
+{
+    laser_hit Result = {};
+    Result.Collision.t = MaxLaserDistance;
+    
+    for (u32 LineIndex = 0; LineIndex < Map->Lines.Count; LineIndex++)
+    {
+        TestOccluder(Map, {Occluder_Line, LineIndex}, P, Direction, &Result);
+    }
+    for (u32 BodyIndex = 0; BodyIndex < Map->RigidBodies.Count; BodyIndex++)
+    {
+        TestOccluder(Map, {Occluder_Body, BodyIndex}, P, Direction, &Result);
+    }
+    return Result;
+}
+
+static laser_hit
+FindNearestLaserHit(map_desc* Map, v2 P, v2 Direction)
+{
+    laser_bvh* BVH = &Map->LaserBVH;
+    
+    ray_segments_kernel* Kernel = GetRaySegmentsKernel(GlobalSimdLevel);
+    
+    laser_hit Result = {};
+    Result.Collision.t = MaxLaserDistance;
+    
+    u32 Stack[64];
+    u32 StackCount = 0;
+    if (BVH->NodeCount > 0)
+    {
+        Stack[StackCount++] = 0;
+    }
+    
+    while (StackCount > 0)
+    {
+        laser_bvh_node* Node = BVH->Nodes + Stack[--StackCount];
+        
+        //Nodes entered exactly at the nearest distance can still win a tie
+        f32 EntryT;
+        if (!RayHitsBounds(P, Direction, Node->Bounds, Result.Collision.t, &EntryT))
+        {
+            continue;
+        }
+        
+        if (Node->Count)
+        {
+            TestLeafSegments(Map, Kernel, Node, P, Direction, &Result);
+        }
+        else
+        {
+            //Visit the nearer child first so the farther one is more often culled
+            u32 Near = Node->First;
+            u32 Far = Node->First + 1;
+            f32 NearT, FarT;
+            bool HitsNear = RayHitsBounds(P, Direction, BVH->Nodes[Near].Bounds, Result.Collision.t, &NearT);
+            bool HitsFar = RayHitsBounds(P, Direction, BVH->Nodes[Far].Bounds, Result.Collision.t, &FarT);
+            if (HitsNear && HitsFar && FarT < NearT)
+            {
+                u32 Swap = Near;
+                Near = Far;
+                Far = Swap;
+            }
+            
+            Assert(StackCount + 2 <= ArrayCount(Stack));
+            if (HitsFar || HitsNear)
+            {
+                Stack[StackCount++] = Far;
+                Stack[StackCount++] = Near;
+            }
+        }
+    }
+
+#if DEBUG
+    laser_hit Expected = FindNearestLaserHitBruteForce(Map, P, Direction);
+    Assert(Result.Collision.DidHit == Expected.Collision.DidHit);
+    Assert(!Expected.Collision.DidHit || (Result.Collision.t == Expected.Collision.t && Result.Key == Expected.Key));
+    Assert(!Expected.Collision.DidHit || (Result.Collision.Normal.X == Expected.Collision.Normal.X && 
+                                          Result.Collision.Normal.Y == Expected.Collision.Normal.Y));
+#endif
+    
+    return Result;
+}
+
+//
+//----------Laser grid----------
+//
+
+f32 const LaserGridCellSize = 0.04f; //The editor's TileSize, maps are built on it
+
+static inline bool
+IsStaticOccluder(map_desc* Map, laser_occluder Occluder)
+{
+    bool Result = (Occluder.Type == Occluder_Body && Map->RigidBodies[Occluder.Index].Static);
+    return Result;
+}
+
+//Bins occluders by their padded bounds, so a ray hitting one anywhere in a cell finds it in that cell
+static broadphase_grid
+BinOccluders(map_desc* Map, bool Static, memory_arena* Arena)
+{
+    laser_bvh* BVH = &Map->LaserBVH;
+    
+    u32 EntryCount = 0;
+    for (u32 Index = 0; Index < BVH->Occluders.Count; Index++)
+    {
+        if (IsStaticOccluder(Map, BVH->Occluders[Index]) == Static)
+        {
+            EntryCount += CountCells(LaserGridCellSize, BVH->OccluderBounds[Index]);
+        }
+    }
+    
+    broadphase_grid Grid = CreateGrid(Arena, LaserGridCellSize, EntryCount);
+    for (u32 Index = 0; Index < BVH->Occluders.Count; Index++)
+    {
+        if (IsStaticOccluder(Map, BVH->Occluders[Index]) == Static)
+        {
+            InsertIntoGrid(&Grid, Index, BVH->OccluderBounds[Index]);
+        }
+    }
+    return Grid;
+}
+
+static void
+BuildLaserGrid(map_desc* Map, memory_arena* Arena)
+{
+    Map->LaserGrid = {};
+    Map->LaserGrid.Static = BinOccluders(Map, true, Arena);
+}
+
+//Called at the start of the laser stage, after the refit
+static void
+RebinLaserGrid(map_desc* Map, memory_arena* TArena)
+{
+    laser_grid* Grid = &Map->LaserGrid;
+    Grid->Moving = BinOccluders(Map, false, TArena);
+    Grid->Bounds = (Map->LaserBVH.NodeCount > 0) ? Map->LaserBVH.Nodes[0].Bounds : rect{};
+}
+
+static void
+TestGridCell(map_desc* Map, broadphase_grid* Grid, i32 CellX, i32 CellY, v2 P, v2 Direction, laser_hit* Nearest)
+{
+    u32 EntryIndex = Grid->Buckets[CellHash(CellX, CellY) & (Grid->BucketCount - 1)];
+    while (EntryIndex)
+    {
+        broadphase_entry* Entry = Grid->Entries + (EntryIndex - 1);
+        if (Entry->CellX == CellX && Entry->CellY == CellY)
+        {
+            TestOccluder(Map, Map->LaserBVH.Occluders[Entry->Index], P, Direction, Nearest);
+        }
+        EntryIndex = Entry->Next;
+    }
+}
+
+//Walks the cells the ray passes through in order (2D DDA). Once the nearest hit so far is inside the cell
+//just walked, nothing in a later cell can be nearer and the walk stops.
+static laser_hit
+FindNearestLaserHitGrid(map_desc* Map, v2 P, v2 Direction)
+{
+    laser_grid* Grid = &Map->LaserGrid;
+    f32 CellSize = LaserGridCellSize;
+    f32 Never = 1e30f;
+    
+    laser_hit Result = {};
+    Result.Collision.t = MaxLaserDistance;
+    
+    f32 EnterT, ExitT;
+    if (Map->LaserBVH.NodeCount > 0 && RayBoundsInterval(P, Direction, Grid->Bounds, MaxLaserDistance, &EnterT, &ExitT))
+    {
+        //Rounding can put the first cell one off near its edge, the padding on the bounds covers for that
+        v2 Entry = P + EnterT * Direction;
+        i32 CellX = CellOf(CellSize, Entry.X);
+        i32 CellY = CellOf(CellSize, Entry.Y);
+        
+        i32 StepX = (Direction.X > 0.0f) ? 1 : -1;
+        i32 StepY = (Direction.Y > 0.0f) ? 1 : -1;
+        f32 NextX = (Direction.X != 0.0f) ? ((CellX + (StepX > 0)) * CellSize - P.X) / Direction.X : Never;
+        f32 NextY = (Direction.Y != 0.0f) ? ((CellY + (StepY > 0)) * CellSize - P.Y) / Direction.Y : Never;
+        f32 DeltaX = (Direction.X != 0.0f) ? CellSize / Abs(Direction.X) : Never;
+        f32 DeltaY = (Direction.Y != 0.0f) ? CellSize / Abs(Direction.Y) : Never;
+        
+        while (true)
+        {
+            TestGridCell(Map, &Grid->Static, CellX, CellY, P, Direction, &Result);
+            TestGridCell(Map, &Grid->Moving, CellX, CellY, P, Direction, &Result);
+            
+            f32 CellExitT = Min(NextX, NextY);
+            if ((Result.Collision.DidHit && Result.Collision.t <= CellExitT) || CellExitT > ExitT)
+            {
+                break;
+            }
+            
+            if (NextX < NextY)
+            {
+                CellX += StepX;
+                NextX += DeltaX;
+            }
+            else
+            {
+                CellY += StepY;
+                NextY += DeltaY;
+            }
+        }
+    }
+
+#if DEBUG
+    laser_hit Expected = FindNearestLaserHitBruteForce(Map, P, Direction);
+    Assert(Result.Collision.DidHit == Expected.Collision.DidHit);
+    Assert(!Expected.Collision.DidHit || (Result.Collision.t == Expected.Collision.t && Result.Key == Expected.Key));
+#endif
+    
+    return Result;
+}
+
+static laser_hit
+FindLaserHit(map_desc* Map, v2 P, v2 Direction)
+{
+    laser_hit Result = {};
+    switch (Map->LaserMode)
+    {
+        case LaserTrace_BVH:        Result = FindNearestLaserHit(Map, P, Direction); break;
+        case LaserTrace_Grid:       Result = FindNearestLaserHitGrid(Map, P, Direction); break;
+        case LaserTrace_BruteForce: Result = FindNearestLaserHitBruteForce(Map, P, Direction); break;
+        default: Assert(0);
+    }
+    return Result;
+}
+
+//
+//----------Reflections----------
+//
+
+u32 const DefaultBounceLimit = 9;
+u32 const MaxBounceLimit = 63;
+
+static u32
+BounceLimitOf(map_element* MapElem)
+{
+    u32 Result = MapElem->BounceLimit ? MapElem->BounceLimit : DefaultBounceLimit;
+    if (Result > MaxBounceLimit)
+    {
+        Result = MaxBounceLimit;
+    }
+    return Result;
+}
+
+//Fills Result from the start, at most Result.Count beams, and returns how many were written. Entities hit
+//in the beam's own color are added to Activated, the map itself isn't changed.
+static u32
+CalculateReflections(span<laser_beam> Result, map_desc* Map, laser* Laser, static_array<u32>* Activated)
+{
+    u32 MaxIter = Result.Count;
+    
+    v2 P = Laser->Position;
+    f32 AngleRadians = Laser->Angle * 2 * 3.14159f;
+    v2 Direction = { cosf(AngleRadians), sinf(AngleRadians) };
+    
+    bool Done = false;
+    
+    u32 Color = Laser->Color;
+    
+    u32 Iter = 0;
+    for (; Iter < MaxIter; Iter++)
+    {
+        laser_hit Hit = FindLaserHit(Map, P, Direction);
+        ray_collision NearestCollision = Hit.Collision;
+        
+        if (NearestCollision.DidHit)
+        {
+            laser_beam* LaserBeam = &Result[Iter];
+            LaserBeam->Start = P;
+            LaserBeam->End = NearestCollision.P;
+            LaserBeam->Color = Color;
+            
+            entity_color HitColor = Map->EntityColors[Hit.EntityIndex];
+            if (Hit.EntityIndex && Color == HitColor.Color)
+            {
+                Add(Activated, Hit.EntityIndex);
+            }
+            
+            if (Hit.Reflective)
+            {
+                P = NearestCollision.P;
+                Direction = Direction - 2 * DotProduct(Direction, UnitV(NearestCollision.Normal)) * UnitV(NearestCollision.Normal);
+            }
+            else if (Hit.Translucent)
+            {
+                P = NearestCollision.P + 0.0001f * Direction;
+                Color = PackedMinU8(Color, HitColor.Filter);
+            }
+            else
+            {
+                Done = true;
+                break;
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+    
+    if (!Done && Iter < MaxIter)
+    {
+        laser_beam* LaserBeam = &Result[Iter];
+        LaserBeam->Start = P;
+        LaserBeam->End = P + 10.0f * UnitV(Direction);
+        LaserBeam->Color = Color;
+        Iter++;
+    }
+    else if (Done)
+    {
+        Iter++; //The beam that ended on something opaque
+    }
+    
+    return Iter;
+}
+
+static bool
+PathCrossesAny(laser_trace* Trace, span<rect> Areas)
+{
+    for (u32 BeamIndex = 0; BeamIndex < Trace->BeamCount; BeamIndex++)
+    {
+        laser_beam Beam = Trace->Beams[BeamIndex];
+        for (rect Area : Areas)
+        {
+            f32 EntryT;
+            if (RayHitsBounds(Beam.Start, Beam.End - Beam.Start, Area, 1.0f, &EntryT))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//Beams only depend on the laser and on what they pass through, so a trace stays good until one of those changes.
+//Being powered only matters through IsActive, which WasActive already covers.
+static bool
+IsTraceValid(laser_trace* Trace, laser* Laser, bool IsActive, span<rect> Moved)
+{
+    laser* Traced = &Trace->Laser;
+    bool SameLaser = (Traced->Position == Laser->Position && Traced->Angle == Laser->Angle && 
+                      Traced->Color == Laser->Color && Traced->MaxBeams == Laser->MaxBeams);
+    
+    bool Result = (Trace->Valid && Trace->WasActive == IsActive && SameLaser && !PathCrossesAny(Trace, Moved));
+    return Result;
+}
+
+static void
+RetraceLaser(map_desc* Map, laser_trace* Trace, laser* Laser, bool IsActive)
+{
+    Trace->Valid = true;
+    Trace->WasActive = IsActive;
+    Trace->Laser = *Laser;
+    Trace->BeamCount = 0;
+    Trace->Activated.Count = 0;
+    
+    if (IsActive)
+    {
+        Trace->BeamCount = CalculateReflections(Trace->Beams, Map, Laser, &Trace->Activated);
+    }
+}
+
+#if DEBUG
+static void
+CheckTraceMatches(map_desc* Map, laser_trace* Trace, laser* Laser, memory_arena* TArena)
+{
+    temporary_memory TempMemory = BeginTemporaryMemory(TArena);
+    
+    span<laser_beam> Beams = AllocSpan(TArena, laser_beam, Laser->MaxBeams);
+    static_array<u32> Activated = AllocStaticArray(TArena, u32, Laser->MaxBeams);
+    
+    u32 BeamCount = Trace->WasActive ? CalculateReflections(Beams, Map, Laser, &Activated) : 0;
+    Assert(BeamCount == Trace->BeamCount);
+    Assert(memcmp(Beams.Memory, Trace->Beams.Memory, BeamCount * sizeof(laser_beam)) == 0);
+    Assert(Activated.Count == Trace->Activated.Count);
+    Assert(memcmp(Activated.Memory, Trace->Activated.Memory, Activated.Count * sizeof(u32)) == 0);
+    
+    EndTemporaryMemory(TempMemory);
+}
+#endif
+
+static void
+AllocLaserTraces(map_desc* Map, memory_arena* Arena)
+{
+    Map->LaserCaching = true;
+    Map->MultithreadedLasers = true;
+    Map->LaserTraces = AllocSpan(Arena, laser_trace, Map->Lasers.Count);
+    
+    u32 TotalBeams = 0;
+    for (u32 LaserIndex = 0; LaserIndex < Map->Lasers.Count; LaserIndex++)
+    {
+        u32 MaxBeams = Map->Lasers[LaserIndex].MaxBeams;
+        Map->LaserTraces[LaserIndex].Beams = AllocSpan(Arena, laser_beam, MaxBeams);
+        Map->LaserTraces[LaserIndex].Activated = AllocStaticArray(Arena, u32, MaxBeams);
+        TotalBeams += MaxBeams;
+    }
+    Map->LaserBeams = AllocStaticArray(Arena, laser_beam, TotalBeams);
+    Map->PrevLaserBeams = AllocStaticArray(Arena, laser_beam, TotalBeams);
+    Map->PrevBeamCounts = AllocSpan(Arena, u32, Map->Lasers.Count);
+}
+
+struct laser_job
+{
+    map_desc* Map;
+    span<rect> Moved;
+    u32 FirstLaser;
+    u32 OnePastLastLaser;
+    
+    u64* ActivatedBits; //One bit per entity
+    laser_stats Stats;
+    memory_arena Arena; //Scratch for the DEBUG checks
+};
+
+//Traces only read the map and write their own laser's trace, so lasers can be traced on any thread
+static void
+TraceLaserJob(void* Data)
+{
+    laser_job* Job = (laser_job*)Data;
+    map_desc* Map = Job->Map;
+    
+    for (u32 LaserIndex = Job->FirstLaser; LaserIndex < Job->OnePastLastLaser; LaserIndex++)
+    {
+        laser* Laser = Map->Lasers + LaserIndex;
+        laser_trace* Trace = Map->LaserTraces + LaserIndex;
+        
+        bool IsActive = Laser->Powered;
+        if (Map->LaserCaching && IsTraceValid(Trace, Laser, IsActive, Job->Moved))
+        {
+            Job->Stats.CacheHits++;
+#if DEBUG
+            CheckTraceMatches(Map, Trace, Laser, &Job->Arena);
+#endif
+        }
+        else
+        {
+            Job->Stats.Retraces++;
+            RetraceLaser(Map, Trace, Laser, IsActive);
+            
+            Job->Stats.RaysCast += Trace->BeamCount;
+            Job->Stats.Bounces += (Trace->BeamCount > 0) ? Trace->BeamCount - 1 : 0;
+        }
+        
+        for (u32 EntityIndex : Trace->Activated)
+        {
+            Job->ActivatedBits[EntityIndex / 64] |= (1ull << (EntityIndex % 64));
+        }
+    }
+}
+
+//The laser stage of a tick. Everything a laser hits in its own color is activated, and the beams are kept
+//for drawing so nothing has to be traced again until the next tick. Lasers whose path nothing moved across
+//keep their last trace.
+//Lasers are traced in batches on the work queue. The beams are gathered in laser order and the activations
+//are merged from bitsets, so the result is the same whatever the thread count.
+static void
+TraceLasers(map_desc* Map, memory_arena* TArena)
+{
+    span<rect> Moved = RefitLaserBVH(Map, TArena);
+    if (Map->LaserMode == LaserTrace_Grid)
+    {
+        RebinLaserGrid(Map, TArena);
+    }
+    
+    u32 const MaxJobCount = 64;
+    u32 const MinLasersPerJob = 8;
+    u32 LaserCount = (Map->Lasers.Count > 1) ? Map->Lasers.Count - 1 : 0; //Laser 0 is the null laser
+    u32 LasersPerJob = (LaserCount + MaxJobCount - 1) / MaxJobCount;
+    LasersPerJob = (LasersPerJob < MinLasersPerJob) ? MinLasersPerJob : LasersPerJob;
+    
+    u32 WordCount = (Map->Entities.Count + 63) / 64;
+    u64 JobArenaSize = (MaxBounceLimit + 1) * (sizeof(laser_beam) + sizeof(u32)) + Kilobytes(1);
+    
+    laser_job* Jobs = AllocArray(TArena, laser_job, MaxJobCount);
+    u32 JobCount = 0;
+    for (u32 First = 1; First < Map->Lasers.Count; First += LasersPerJob)
+    {
+        Assert(JobCount < MaxJobCount);
+        laser_job* Job = Jobs + JobCount++;
+        Job->Map = Map;
+        Job->Moved = Moved;
+        Job->FirstLaser = First;
+        Job->OnePastLastLaser = (Map->Lasers.Count - First < LasersPerJob) ? Map->Lasers.Count : First + LasersPerJob;
+        Job->ActivatedBits = AllocArray(TArena, u64, WordCount);
+        Job->Arena = CreateSubArena(TArena, JobArenaSize);
+    }
+    
+    bool Threaded = Map->MultithreadedLasers && GlobalWorkQueue && JobCount > 1;
+    for (u32 JobIndex = 0; JobIndex < JobCount; JobIndex++)
+    {
+        if (Threaded)
+        {
+            PlatformAddWork(GlobalWorkQueue, TraceLaserJob, Jobs + JobIndex);
+        }
+        else
+        {
+            TraceLaserJob(Jobs + JobIndex);
+        }
+    }
+    
+    if (Threaded)
+    {
+        PlatformCompleteAllWork(GlobalWorkQueue);
+    }
+    
+    BeginActivations(Map);
+    
+    u64* ActivatedBits = AllocArray(TArena, u64, WordCount);
+    for (u32 JobIndex = 0; JobIndex < JobCount; JobIndex++)
+    {
+        laser_job* Job = Jobs + JobIndex;
+        for (u32 Word = 0; Word < WordCount; Word++)
+        {
+            ActivatedBits[Word] |= Job->ActivatedBits[Word];
+        }
+        
+        Map->LaserStats.CacheHits += Job->Stats.CacheHits;
+        Map->LaserStats.Retraces += Job->Stats.Retraces;
+        Map->LaserStats.RaysCast += Job->Stats.RaysCast;
+        Map->LaserStats.Bounces += Job->Stats.Bounces;
+    }
+    
+    for (u32 Word = 0; Word < WordCount; Word++)
+    {
+        u64 Bits = ActivatedBits[Word];
+        for (u32 Bit = 0; Bits; Bit++, Bits >>= 1)
+        {
+            if (Bits & 1)
+            {
+                ActivateEntity(Map, 64 * Word + Bit);
+            }
+        }
+    }
+    
+    Map->LaserBeams.Count = 0;
+    for (u32 LaserIndex = 1; LaserIndex < Map->Lasers.Count; LaserIndex++)
+    {
+        laser_trace* Trace = Map->LaserTraces + LaserIndex;
+        
+        Assert(Map->LaserBeams.Count + Trace->BeamCount <= Map->LaserBeams.Capacity);
+        memcpy(Map->LaserBeams.Memory + Map->LaserBeams.Count, Trace->Beams.Memory, Trace->BeamCount * sizeof(laser_beam));
+        Map->LaserBeams.Count += Trace->BeamCount;
+    }
+    
+    EndActivations(Map);
+}
@@ -56,6 +56,12 @@ float DotProduct(v2 A, v2 B)
 	return A.X * B.X + A.Y * B.Y;
 }
 
+//Z of the 3D cross product, positive when B is anticlockwise from A
+float CrossProduct(v2 A, v2 B)
+{
+	return A.X * B.Y - A.Y * B.X;
+}
+
 inline v2 UnitV(v2 Vec)
 {
 	v2 Res;
@@ -3,27 +3,169 @@ struct collision
     bool DidCollide;
     v2 Normal; //Normal is from A to B
     f32 Penetration;
+    
+    //Filled in by the solver, the kernels leave these zeroed
+    bool Active;
+    f32 Impulse;
 };
 
+static inline v2&
+BodyP(physics_world* World, u32 BodyIndex)
+{
+    Assert(BodyIndex < World->BodyCount);
+    return World->P[BodyIndex];
+}
+
+static inline v2&
+BodydP(physics_world* World, u32 BodyIndex)
+{
+    Assert(BodyIndex < World->BodyCount);
+    return World->dP[BodyIndex];
+}
+
+static inline v2&
+BodySize(physics_world* World, u32 BodyIndex)
+{
+    Assert(BodyIndex < World->BodyCount);
+    return World->Size[BodyIndex];
+}
+
+static inline f32
+BodyInvMass(physics_world* World, u32 BodyIndex)
+{
+    Assert(BodyIndex < World->BodyCount);
+    return World->InvMass[BodyIndex];
+}
+
 static inline rect
-RectOf(rigid_body RigidBody)
+RectOf(physics_world* World, u32 BodyIndex)
 {
-    Assert(RigidBody.Type == RigidBody_AABB);
-    v2 MinCorner = RigidBody.P - 0.5f * RigidBody.Size;
-    v2 MaxCorner = RigidBody.P + 0.5f * RigidBody.Size;
+    v2 MinCorner = BodyP(World, BodyIndex) - 0.5f * BodySize(World, BodyIndex);
+    v2 MaxCorner = BodyP(World, BodyIndex) + 0.5f * BodySize(World, BodyIndex);
     return {MinCorner, MaxCorner};
 }
 
-static collision
-TestAABBAABBCollision(rigid_body* A, rigid_body* B)
+static inline f32
+RadiusOf(physics_world* World, u32 BodyIndex)
+{
+    return 0.5f * BodySize(World, BodyIndex).X;
+}
+
+//Where a body is drawn, Alpha of the way from the previous tick to the current one
+static inline v2
+InterpolatedP(physics_world* World, u32 BodyIndex, f32 Alpha)
+{
+    return LinearInterpolate(World->PrevP[BodyIndex], BodyP(World, BodyIndex), Alpha);
+}
+
+static inline v2
+InterpolatedSize(physics_world* World, u32 BodyIndex, f32 Alpha)
+{
+    return LinearInterpolate(World->PrevSize[BodyIndex], BodySize(World, BodyIndex), Alpha);
+}
+
+static inline rect
+InterpolatedRectOf(physics_world* World, u32 BodyIndex, f32 Alpha)
+{
+    v2 P = InterpolatedP(World, BodyIndex, Alpha);
+    v2 Size = InterpolatedSize(World, BodyIndex, Alpha);
+    return {P - 0.5f * Size, P + 0.5f * Size};
+}
+
+static void
+SavePreviousState(physics_world* World)
+{
+    memcpy(World->PrevP, World->P, World->BodyCount * sizeof(v2));
+    memcpy(World->PrevSize, World->Size, World->BodyCount * sizeof(v2));
+}
+
+u32 const DefaultVelocityIterations = 4;
+
+static physics_world
+CreatePhysicsWorld(memory_arena* Arena, u32 Capacity)
 {
-    Assert(A->Type == RigidBody_AABB);
-    Assert(B->Type == RigidBody_AABB);
+    physics_world World = {};
+    World.Capacity = Capacity;
+    World.P = AllocArray(Arena, v2, Capacity);
+    World.dP = AllocArray(Arena, v2, Capacity);
+    World.Size = AllocArray(Arena, v2, Capacity);
+    World.InvMass = AllocArray(Arena, f32, Capacity);
+    World.PrevP = AllocArray(Arena, v2, Capacity);
+    World.PrevSize = AllocArray(Arena, v2, Capacity);
+    World.SleepingEnabled = true;
+    World.Multithreaded = true;
+    World.ContinuousCollision = true;
+    World.Awake = AllocArray(Arena, bool, Capacity);
+    World.RestingTime = AllocArray(Arena, f32, Capacity);
+    World.SleepIsland = AllocArray(Arena, u32, Capacity);
+    World.NextInIsland = AllocArray(Arena, u32, Capacity);
+    World.LastBounds = AllocArray(Arena, rect, Capacity);
     
-    collision Result = {};
+    World.WarmStarting = true;
+    World.VelocityIterations = DefaultVelocityIterations;
     
-    rect RectA = RectOf(*A);
-    rect RectB = RectOf(*B);
+    //Kept at most half full so probe chains stay short
+    u32 CacheCapacity = 64;
+    while (CacheCapacity < 8 * Capacity)
+    {
+        CacheCapacity *= 2;
+    }
+    World.ContactCache.Capacity = CacheCapacity;
+    World.ContactCache.Stamp = 1;
+    World.ContactCache.Entries = AllocArray(Arena, cached_contact, CacheCapacity);
+    return World;
+}
+
+static u32
+AddBody(physics_world* World, v2 P, v2 Size, f32 InvMass)
+{
+    Assert(World->BodyCount < World->Capacity);
+    u32 Result = World->BodyCount++;
+    World->P[Result] = P;
+    World->dP[Result] = {};
+    World->Size[Result] = Size;
+    World->InvMass[Result] = InvMass;
+    World->PrevP[Result] = P;
+    World->PrevSize[Result] = Size;
+    World->Awake[Result] = (InvMass != 0.0f);
+    World->RestingTime[Result] = 0.0f;
+    World->SleepIsland[Result] = Result;
+    World->NextInIsland[Result] = 0;
+    World->LastBounds[Result] = RectOf(World, Result);
+    return Result;
+}
+
+static inline bool
+IsDynamic(physics_world* World, u32 BodyIndex)
+{
+    return BodyInvMass(World, BodyIndex) != 0.0f;
+}
+
+static inline bool
+IsAwake(physics_world* World, u32 BodyIndex)
+{
+    Assert(BodyIndex < World->BodyCount);
+    return World->Awake[BodyIndex];
+}
+
+static inline bool
+IsSleeping(physics_world* World, u32 BodyIndex)
+{
+    return IsDynamic(World, BodyIndex) && !IsAwake(World, BodyIndex);
+}
+
+//A pair needs something that can move into the other, and something that can be pushed
+static inline bool
+ShouldTestPair(physics_world* World, u32 IndexA, u32 IndexB)
+{
+    bool Result = (IsAwake(World, IndexA) || IsAwake(World, IndexB)) && (IsDynamic(World, IndexA) || IsDynamic(World, IndexB));
+    return Result;
+}
+
+static collision
+TestAABBAABBCollision(rect RectA, rect RectB)
+{
+    collision Result = {};
     
     if (RectanglesCollide(RectA, RectB))
     {
@@ -60,15 +202,12 @@ TestAABBAABBCollision(rigid_body* A, rigid_body* B)
 }
 
 static collision
-TestCircleCircleCollision(rigid_body* A, rigid_body* B)
+TestCircleCircleCollision(v2 PA, f32 RadiusA, v2 PB, f32 RadiusB)
 {
-    Assert(A->Type == RigidBody_Circle);
-    Assert(B->Type == RigidBody_Circle);
-    
     collision Result = {};
     
-    f32 SumOfRadii = 0.5f * (A->Size.X + B->Size.X);
-    v2 Direction = B->P - A->P;
+    f32 SumOfRadii = RadiusA + RadiusB;
+    v2 Direction = PB - PA;
     f32 Dist = Length(Direction);
     
     if (Dist < SumOfRadii)
@@ -82,23 +221,16 @@ TestCircleCircleCollision(rigid_body* A, rigid_body* B)
 }
 
 static collision
-TestAABBCircleCollision(rigid_body* AABB, rigid_body* Circle)
+TestAABBCircleCollision(rect Rect, v2 CircleP, f32 Radius)
 {
-    Assert(AABB->Type == RigidBody_AABB);
-    Assert(Circle->Type == RigidBody_Circle);
-    
     collision Result = {};
     
-    rect Rect = RectOf(*AABB);
-    
-    f32 NearestX = Clamp(Circle->P.X, Rect.MinCorner.X, Rect.MaxCorner.X);
-    f32 NearestY = Clamp(Circle->P.Y, Rect.MinCorner.Y, Rect.MaxCorner.Y);
+    f32 NearestX = Clamp(CircleP.X, Rect.MinCorner.X, Rect.MaxCorner.X);
+    f32 NearestY = Clamp(CircleP.Y, Rect.MinCorner.Y, Rect.MaxCorner.Y);
     
-    v2 Direction = Circle->P - V2(NearestX, NearestY);
+    v2 Direction = CircleP - V2(NearestX, NearestY);
     f32 Dist = Length(Direction);
     
-    f32 Radius = 0.5f * Circle->Size.X;
-    
     if (Dist < Radius)
     {
         Result.DidCollide = true;
@@ -109,85 +241,2337 @@ TestAABBCircleCollision(rigid_body* AABB, rigid_body* Circle)
     return Result;
 }
 
-static void
-PhysicsUpdate(span<rigid_body> RigidBodies, f32 DeltaTime, v2 Movement, rigid_body* Controlling)
+struct time_of_impact
 {
-    v2 Gravity = V2(0.0f, -2.5f);
+    bool DidHit;
+    f32 Time; //Fraction of the motion covered before touching
+    v2 Normal; //Out of the obstacle
+};
+
+//Slab test of the segment from Start to Start + Delta. Starting inside or touching isn't a hit, that
+//overlap is left to the contact solver.
+static time_of_impact
+RayRectangleImpact(v2 Start, v2 Delta, rect Rect)
+{
+    time_of_impact Result = {};
+    
+    f32 Starts[] = {Start.X, Start.Y};
+    f32 Deltas[] = {Delta.X, Delta.Y};
+    f32 Mins[] = {Rect.MinCorner.X, Rect.MinCorner.Y};
+    f32 Maxs[] = {Rect.MaxCorner.X, Rect.MaxCorner.Y};
+    v2 Axes[] = {V2(1.0f, 0.0f), V2(0.0f, 1.0f)};
+    
+    f32 Enter = 0.0f;
+    f32 Exit = 1.0f;
+    v2 Normal = {};
+    
+    for (u32 Axis = 0; Axis < 2; Axis++)
+    {
+        if (Deltas[Axis] == 0.0f)
+        {
+            if (Starts[Axis] <= Mins[Axis] || Starts[Axis] >= Maxs[Axis])
+            {
+                return Result;
+            }
+            continue;
+        }
+        
+        //Moving up the axis enters through the min side
+        bool Positive = (Deltas[Axis] > 0.0f);
+        f32 TimeToMin = (Mins[Axis] - Starts[Axis]) / Deltas[Axis];
+        f32 TimeToMax = (Maxs[Axis] - Starts[Axis]) / Deltas[Axis];
+        f32 TimeIn = Positive ? TimeToMin : TimeToMax;
+        f32 TimeOut = Positive ? TimeToMax : TimeToMin;
+        
+        if (TimeIn > Enter)
+        {
+            Enter = TimeIn;
+            Normal = Positive ? -1.0f * Axes[Axis] : Axes[Axis];
+        }
+        Exit = Min(Exit, TimeOut);
+    }
+    
+    if (Enter < Exit && (Normal.X != 0.0f || Normal.Y != 0.0f))
+    {
+        Result.DidHit = true;
+        Result.Time = Enter;
+        Result.Normal = Normal;
+    }
+    return Result;
+}
+
+static time_of_impact
+SweptAABBImpact(rect Moving, v2 Delta, rect Obstacle)
+{
+    //Grow the obstacle by the moving box so the box can be treated as its center point
+    v2 HalfSize = 0.5f * (Moving.MaxCorner - Moving.MinCorner);
+    rect Grown = {Obstacle.MinCorner - HalfSize, Obstacle.MaxCorner + HalfSize};
+    
+    v2 Center = 0.5f * (Moving.MinCorner + Moving.MaxCorner);
+    time_of_impact Result = RayRectangleImpact(Center, Delta, Grown);
+    return Result;
+}
+
+static time_of_impact
+SweptCircleImpact(v2 P, f32 Radius, v2 Delta, rect Obstacle)
+{
+    rect Grown = {Obstacle.MinCorner - V2(Radius, Radius), Obstacle.MaxCorner + V2(Radius, Radius)};
+    time_of_impact Result = RayRectangleImpact(P, Delta, Grown);
     
-    int PhysicsIterPerFrame = 3;
-    f32 TimeStep = DeltaTime / (f32)PhysicsIterPerFrame;
-    for (int Iter = 0; Iter < PhysicsIterPerFrame; Iter++)
+    if (Result.DidHit)
     {
-        for (rigid_body& RigidBody : RigidBodies)
+        //The grown rectangle has square corners where the real shape is rounded, redo those against the corner
+        v2 HitP = P + Result.Time * Delta;
+        v2 Corner = V2(Clamp(HitP.X, Obstacle.MinCorner.X, Obstacle.MaxCorner.X), 
+                       Clamp(HitP.Y, Obstacle.MinCorner.Y, Obstacle.MaxCorner.Y));
+        
+        if (Corner.X != HitP.X && Corner.Y != HitP.Y)
         {
-            f32 Friction = 10.0f;
+            v2 FromCorner = P - Corner;
+            f32 a = LengthSq(Delta);
+            f32 b = 2.0f * DotProduct(FromCorner, Delta);
+            f32 c = LengthSq(FromCorner) - Square(Radius);
+            f32 Discriminant = b * b - 4.0f * a * c;
             
-            v2 Accel = Gravity - Friction * RigidBody.dP;
-            if (&RigidBody == Controlling)
+            f32 Time = (Discriminant >= 0.0f) ? (-b - sqrtf(Discriminant)) / (2.0f * a) : -1.0f;
+            if (Time >= 0.0f && Time <= 1.0f)
+            {
+                Result.Time = Time;
+                Result.Normal = UnitV(P + Time * Delta - Corner);
+            }
+            else
             {
-                f32 Speed = 5.0f;
-                Accel += Speed * Movement;
+                Result = {};
             }
+        }
+    }
+    return Result;
+}
+
+static inline u32
+CellHash(i32 CellX, i32 CellY)
+{
+    u32 Result = ((u32)CellX * 73856093u) ^ ((u32)CellY * 19349663u);
+    return Result;
+}
+
+static inline i32
+CellOf(f32 CellSize, f32 Coordinate)
+{
+    return Floor(Coordinate / CellSize);
+}
+
+static broadphase_grid
+CreateGrid(memory_arena* Arena, f32 CellSize, u32 EntryCount)
+{
+    broadphase_grid Grid = {};
+    Grid.CellSize = CellSize;
+    
+    Grid.BucketCount = 64;
+    while (Grid.BucketCount < 2 * EntryCount)
+    {
+        Grid.BucketCount *= 2;
+    }
+    
+    Grid.Buckets = AllocArray(Arena, u32, Grid.BucketCount);
+    Grid.Entries = AllocStaticArray(Arena, broadphase_entry, EntryCount);
+    return Grid;
+}
+
+static u32
+CountCells(f32 CellSize, rect Bounds)
+{
+    i32 CellsX = CellOf(CellSize, Bounds.MaxCorner.X) - CellOf(CellSize, Bounds.MinCorner.X) + 1;
+    i32 CellsY = CellOf(CellSize, Bounds.MaxCorner.Y) - CellOf(CellSize, Bounds.MinCorner.Y) + 1;
+    
+    u32 Result = (CellsX > 0 && CellsY > 0) ? (u32)(CellsX * CellsY) : 0;
+    return Result;
+}
+
+static void
+InsertIntoGrid(broadphase_grid* Grid, u32 Index, rect Bounds)
+{
+    for (i32 CellY = CellOf(Grid->CellSize, Bounds.MinCorner.Y); CellY <= CellOf(Grid->CellSize, Bounds.MaxCorner.Y); CellY++)
+    {
+        for (i32 CellX = CellOf(Grid->CellSize, Bounds.MinCorner.X); CellX <= CellOf(Grid->CellSize, Bounds.MaxCorner.X); CellX++)
+        {
+            u32* Bucket = Grid->Buckets + (CellHash(CellX, CellY) & (Grid->BucketCount - 1));
             
-            v2 ddP = Accel * RigidBody.InvMass;
+            broadphase_entry Entry = {};
+            Entry.CellX = CellX;
+            Entry.CellY = CellY;
+            Entry.Index = Index;
+            Entry.Next = *Bucket;
             
-            RigidBody.P += TimeStep * RigidBody.dP + 0.5f * ddP * Square(TimeStep);
-            RigidBody.dP += TimeStep * ddP;
+            *Bucket = Add(&Grid->Entries, Entry) + 1;
         }
-        
-        for (u32 IndexA = 0; IndexA < RigidBodies.Count; IndexA++)
+    }
+}
+
+f32 const BroadphaseCellSize = 0.08f;
+f32 const BroadphaseMargin = 0.005f; //Catches pairs pushed into contact by earlier resolutions in the same sub-step
+
+static inline rect
+FatBoundsOf(physics_world* World, u32 BodyIndex)
+{
+    rect Result = RectOf(World, BodyIndex);
+    Result.MinCorner -= V2(BroadphaseMargin, BroadphaseMargin);
+    Result.MaxCorner += V2(BroadphaseMargin, BroadphaseMargin);
+    return Result;
+}
+
+static void
+BuildStaticGeometry(map_desc* Map, memory_arena* Arena)
+{
+    physics_world* World = &Map->Physics;
+    
+    u32 StaticCount = 0;
+    u32 KinematicCount = 0;
+    u32 EntryCount = 0;
+    for (u32 BodyIndex = 0; BodyIndex < Map->RigidBodies.Count; BodyIndex++)
+    {
+        if (Map->RigidBodies[BodyIndex].Static)
         {
-            rigid_body* A = RigidBodies + IndexA;
-            for (u32 IndexB = 0; IndexB < IndexA; IndexB++)
+            StaticCount++;
+            EntryCount += CountCells(BroadphaseCellSize, FatBoundsOf(World, BodyIndex));
+        }
+        else if (!IsDynamic(World, BodyIndex))
+        {
+            KinematicCount++;
+        }
+    }
+    
+    static_geometry Statics = {};
+    Statics.Bodies = AllocSpan(Arena, u32, StaticCount);
+    Statics.Bounds = AllocSpan(Arena, rect, StaticCount);
+    Statics.Grid = CreateGrid(Arena, BroadphaseCellSize, EntryCount);
+    Statics.Kinematic = AllocSpan(Arena, u32, KinematicCount);
+    
+    u32 StaticIndex = 0;
+    u32 KinematicIndex = 0;
+    for (u32 BodyIndex = 0; BodyIndex < Map->RigidBodies.Count; BodyIndex++)
+    {
+        if (Map->RigidBodies[BodyIndex].Static)
+        {
+            Statics.Bodies[StaticIndex] = BodyIndex;
+            Statics.Bounds[StaticIndex] = FatBoundsOf(World, BodyIndex);
+            InsertIntoGrid(&Statics.Grid, StaticIndex, Statics.Bounds[StaticIndex]);
+            StaticIndex++;
+        }
+        else if (!IsDynamic(World, BodyIndex))
+        {
+            Statics.Kinematic[KinematicIndex++] = BodyIndex;
+        }
+    }
+    
+    Map->StaticGeometry = Statics;
+}
+
+static void
+BuildBroadphase(map_desc* Map, memory_arena* Arena)
+{
+    physics_world* World = &Map->Physics;
+    
+    u32 MovingCount = Map->RigidBodies.Count - Map->StaticGeometry.Bodies.Count;
+    span<u32> SortedBodies = AllocSpan(Arena, u32, MovingCount);
+    
+    u32 SortedIndex = 0;
+    for (u32 BodyIndex = 0; BodyIndex < Map->RigidBodies.Count; BodyIndex++)
+    {
+        if (!Map->RigidBodies[BodyIndex].Static)
+        {
+            SortedBodies[SortedIndex++] = BodyIndex;
+        }
+    }
+    Map->Broadphase.SortedBodies = SortedBodies;
+    
+    //Sized for every dynamic body asleep at once, wherever it lies against the cells
+    u32 SleepingEntryCount = 0;
+    for (u32 BodyIndex = 0; BodyIndex < Map->RigidBodies.Count; BodyIndex++)
+    {
+        if (IsDynamic(World, BodyIndex))
+        {
+            v2 FatSize = BodySize(World, BodyIndex) + V2(2.0f * BroadphaseMargin, 2.0f * BroadphaseMargin);
+            u32 CellsX = (u32)Floor(FatSize.X / BroadphaseCellSize) + 2;
+            u32 CellsY = (u32)Floor(FatSize.Y / BroadphaseCellSize) + 2;
+            SleepingEntryCount += CellsX * CellsY;
+        }
+    }
+    Map->Broadphase.SleepingGrid = CreateGrid(Arena, BroadphaseCellSize, SleepingEntryCount);
+    World->SleepingChanged = true;
+}
+
+static void
+UpdateSleepingGrid(broadphase* Broadphase, physics_world* World)
+{
+    if (!World->SleepingChanged)
+    {
+        return;
+    }
+    
+    broadphase_grid* Grid = &Broadphase->SleepingGrid;
+    memset(Grid->Buckets, 0, Grid->BucketCount * sizeof(u32));
+    Grid->Entries.Count = 0;
+    
+    for (u32 BodyIndex = 0; BodyIndex < World->BodyCount; BodyIndex++)
+    {
+        if (IsSleeping(World, BodyIndex))
+        {
+            InsertIntoGrid(Grid, BodyIndex, FatBoundsOf(World, BodyIndex));
+        }
+    }
+    World->SleepingChanged = false;
+}
+
+static void
+QueryGrid(memory_arena* Arena, broadphase_grid* Grid, physics_world* World, u32 BodyIndex, rect Bounds)
+{
+    for (i32 CellY = CellOf(Grid->CellSize, Bounds.MinCorner.Y); CellY <= CellOf(Grid->CellSize, Bounds.MaxCorner.Y); CellY++)
+    {
+        for (i32 CellX = CellOf(Grid->CellSize, Bounds.MinCorner.X); CellX <= CellOf(Grid->CellSize, Bounds.MaxCorner.X); CellX++)
+        {
+            u32 EntryIndex = Grid->Buckets[CellHash(CellX, CellY) & (Grid->BucketCount - 1)];
+            while (EntryIndex)
             {
-                rigid_body* B = RigidBodies + IndexB;
+                broadphase_entry* Entry = Grid->Entries + (EntryIndex - 1);
+                EntryIndex = Entry->Next;
+                
+                u32 OtherIndex = Entry->Index;
+                if (Entry->CellX != CellX || Entry->CellY != CellY || OtherIndex == BodyIndex)
+                {
+                    continue;
+                }
                 
-                collision Collision = {};
-                if (A->Type == RigidBody_AABB && B->Type == RigidBody_AABB)
+                //Pairs of awake bodies are found from both sides, only the higher index reports them
+                if ((IsAwake(World, OtherIndex) && OtherIndex > BodyIndex) || !ShouldTestPair(World, BodyIndex, OtherIndex))
                 {
-                    Collision = TestAABBAABBCollision(A, B);
+                    continue;
                 }
-                if (A->Type == RigidBody_AABB && B->Type == RigidBody_Circle)
+                
+                rect OtherBounds = FatBoundsOf(World, OtherIndex);
+                if (!RectanglesCollide(Bounds, OtherBounds))
+                {
+                    continue;
+                }
+                
+                //Both bodies can share several cells, only report from the cell holding the corner of the overlap
+                i32 ReferenceX = CellOf(Grid->CellSize, Max(Bounds.MinCorner.X, OtherBounds.MinCorner.X));
+                i32 ReferenceY = CellOf(Grid->CellSize, Max(Bounds.MinCorner.Y, OtherBounds.MinCorner.Y));
+                if (ReferenceX != CellX || ReferenceY != CellY)
                 {
-                    Collision = TestAABBCircleCollision(A, B);
+                    continue;
                 }
-                if (A->Type == RigidBody_Circle && B->Type == RigidBody_AABB)
+                
+                body_pair* Pair = AllocStruct(Arena, body_pair);
+                Pair->A = (BodyIndex > OtherIndex) ? BodyIndex : OtherIndex;
+                Pair->B = (BodyIndex > OtherIndex) ? OtherIndex : BodyIndex;
+            }
+        }
+    }
+}
+
+//Static bodies are never awake and only pair with dynamic ones, so this skips all of QueryGrid()'s checks
+static void
+QueryStaticGeometry(memory_arena* Arena, static_geometry* Statics, physics_world* World, u32 BodyIndex, rect Bounds)
+{
+    if (!IsDynamic(World, BodyIndex))
+    {
+        return;
+    }
+    
+    broadphase_grid* Grid = &Statics->Grid;
+    for (i32 CellY = CellOf(Grid->CellSize, Bounds.MinCorner.Y); CellY <= CellOf(Grid->CellSize, Bounds.MaxCorner.Y); CellY++)
+    {
+        for (i32 CellX = CellOf(Grid->CellSize, Bounds.MinCorner.X); CellX <= CellOf(Grid->CellSize, Bounds.MaxCorner.X); CellX++)
+        {
+            u32 EntryIndex = Grid->Buckets[CellHash(CellX, CellY) & (Grid->BucketCount - 1)];
+            while (EntryIndex)
+            {
+                broadphase_entry* Entry = Grid->Entries + (EntryIndex - 1);
+                EntryIndex = Entry->Next;
+                
+                if (Entry->CellX != CellX || Entry->CellY != CellY)
                 {
-                    Collision = TestAABBCircleCollision(B, A);
-                    Collision.Normal = -1.0f * Collision.Normal;
+                    continue;
                 }
-                if (A->Type == RigidBody_Circle && B->Type == RigidBody_Circle)
+                
+                rect OtherBounds = Statics->Bounds[Entry->Index];
+                if (!RectanglesCollide(Bounds, OtherBounds))
                 {
-                    Collision = TestCircleCircleCollision(A, B);
+                    continue;
                 }
                 
-                if (Collision.DidCollide)
+                //Same as QueryGrid(), only report from the cell holding the corner of the overlap
+                i32 ReferenceX = CellOf(Grid->CellSize, Max(Bounds.MinCorner.X, OtherBounds.MinCorner.X));
+                i32 ReferenceY = CellOf(Grid->CellSize, Max(Bounds.MinCorner.Y, OtherBounds.MinCorner.Y));
+                if (ReferenceX != CellX || ReferenceY != CellY)
                 {
-                    f32 SumInverseMass = A->InvMass + B->InvMass;
-                    
-                    if (SumInverseMass == 0.0f)
-                    {
-                        continue;
-                    }
-                    
-                    A->P -= Collision.Normal * Collision.Penetration * (A->InvMass / SumInverseMass);
-                    B->P += Collision.Normal * Collision.Penetration * (B->InvMass / SumInverseMass);
-                    
-                    v2 VelContact = B->dP - A->dP;
-                    f32 CoefficientOfRestitution = 0.0f;
-                    
-                    f32 ImpulseForce = DotProduct(VelContact, Collision.Normal);
-                    
-                    f32 j = (-(1.0f + CoefficientOfRestitution) * ImpulseForce) / (SumInverseMass);
-                    
-                    v2 Impulse = Collision.Normal * j;
-                    
-                    A->dP -= Impulse * A->InvMass;
-                    B->dP += Impulse * B->InvMass;
+                    continue;
                 }
                 
+                u32 OtherIndex = Statics->Bodies[Entry->Index];
+                body_pair* Pair = AllocStruct(Arena, body_pair);
+                Pair->A = (BodyIndex > OtherIndex) ? BodyIndex : OtherIndex;
+                Pair->B = (BodyIndex > OtherIndex) ? OtherIndex : BodyIndex;
             }
         }
+    }
+}
+
+static int
+ComparePairs(const void* A, const void* B)
+{
+    body_pair* PairA = (body_pair*)A;
+    body_pair* PairB = (body_pair*)B;
+    
+    u64 KeyA = ((u64)PairA->A << 32) | PairA->B;
+    u64 KeyB = ((u64)PairB->A << 32) | PairB->B;
+    
+    int Result = (KeyA > KeyB) - (KeyA < KeyB);
+    return Result;
+}
+
+static span<body_pair>
+FindGridPairs(broadphase* Broadphase, static_geometry* Statics, physics_world* World, span<rigid_body> RigidBodies, memory_arena* TArena)
+{
+    UpdateSleepingGrid(Broadphase, World);
+    
+    //Everything that is neither static nor asleep is re-binned every sub-step
+    u32 MovingEntryCount = 0;
+    for (u32 BodyIndex = 0; BodyIndex < RigidBodies.Count; BodyIndex++)
+    {
+        if (!RigidBodies[BodyIndex].Static && !IsSleeping(World, BodyIndex))
+        {
+            MovingEntryCount += CountCells(BroadphaseCellSize, FatBoundsOf(World, BodyIndex));
+        }
+    }
+    
+    broadphase_grid MovingGrid = CreateGrid(TArena, BroadphaseCellSize, MovingEntryCount);
+    for (u32 BodyIndex = 0; BodyIndex < RigidBodies.Count; BodyIndex++)
+    {
+        if (!RigidBodies[BodyIndex].Static && !IsSleeping(World, BodyIndex))
+        {
+            InsertIntoGrid(&MovingGrid, BodyIndex, FatBoundsOf(World, BodyIndex));
+        }
+    }
+    
+    span<body_pair> Pairs = BeginSpan<body_pair>(TArena);
+    
+    for (u32 BodyIndex = 0; BodyIndex < RigidBodies.Count; BodyIndex++)
+    {
+        if (IsAwake(World, BodyIndex))
+        {
+            rect Bounds = FatBoundsOf(World, BodyIndex);
+            QueryStaticGeometry(TArena, Statics, World, BodyIndex, Bounds);
+            QueryGrid(TArena, &MovingGrid, World, BodyIndex, Bounds);
+            QueryGrid(TArena, &Broadphase->SleepingGrid, World, BodyIndex, Bounds);
+        }
+    }
+    EndSpan(Pairs, TArena);
+    
+    return Pairs;
+}
+
+//Only bodies that can move are swept, static ones come from the static geometry
+static span<body_pair>
+FindSweepAndPrunePairs(broadphase* Broadphase, static_geometry* Statics, physics_world* World, memory_arena* TArena)
+{
+    Assert(Broadphase->SortedBodies.Count + Statics->Bodies.Count == World->BodyCount);
+    
+    span<u32> Sorted = Broadphase->SortedBodies;
+    span<rect> Bounds = AllocSpan(TArena, rect, World->BodyCount);
+    for (u32 BodyIndex : Sorted)
+    {
+        Bounds[BodyIndex] = FatBoundsOf(World, BodyIndex);
+    }
+    
+    //Bodies barely move between sub-steps, so last step's order is almost sorted already
+    for (u32 I = 1; I < Sorted.Count; I++)
+    {
+        u32 BodyIndex = Sorted[I];
+        f32 MinX = Bounds[BodyIndex].MinCorner.X;
         
+        u32 J = I;
+        while (J > 0 && Bounds[Sorted[J - 1]].MinCorner.X > MinX)
+        {
+            Sorted[J] = Sorted[J - 1];
+            J--;
+        }
+        Sorted[J] = BodyIndex;
     }
+    
+    span<body_pair> Pairs = BeginSpan<body_pair>(TArena);
+    
+    for (u32 I = 0; I < Sorted.Count; I++)
+    {
+        u32 IndexA = Sorted[I];
+        rect BoundsA = Bounds[IndexA];
+        
+        for (u32 J = I + 1; J < Sorted.Count; J++)
+        {
+            u32 IndexB = Sorted[J];
+            rect BoundsB = Bounds[IndexB];
+            
+            if (BoundsB.MinCorner.X >= BoundsA.MaxCorner.X)
+            {
+                break;
+            }
+            
+            if (ShouldTestPair(World, IndexA, IndexB) && RectanglesCollide(BoundsA, BoundsB))
+            {
+                body_pair* Pair = AllocStruct(TArena, body_pair);
+                Pair->A = (IndexA > IndexB) ? IndexA : IndexB;
+                Pair->B = (IndexA > IndexB) ? IndexB : IndexA;
+            }
+        }
+        
+        if (IsAwake(World, IndexA))
+        {
+            QueryStaticGeometry(TArena, Statics, World, IndexA, BoundsA);
+        }
+    }
+    EndSpan(Pairs, TArena);
+    
+    return Pairs;
+}
+
+static void
+RecordPairStats(broadphase* Broadphase, u32 BodyCount, u32 CandidatePairs)
+{
+    u32 BruteForcePairs = BodyCount * (BodyCount - 1) / 2;
+    Broadphase->Stats.BodyCount = BodyCount;
+    Broadphase->Stats.BruteForcePairs += BruteForcePairs;
+    Broadphase->Stats.CandidatePairs += CandidatePairs;
+    Broadphase->Stats.CulledPairs += BruteForcePairs - CandidatePairs;
+}
+
+static span<body_pair>
+FindBruteForcePairs(physics_world* World, memory_arena* TArena)
+{
+    span<body_pair> Pairs = BeginSpan<body_pair>(TArena);
+    for (u32 IndexA = 0; IndexA < World->BodyCount; IndexA++)
+    {
+        for (u32 IndexB = 0; IndexB < IndexA; IndexB++)
+        {
+            if (ShouldTestPair(World, IndexA, IndexB) && RectanglesCollide(FatBoundsOf(World, IndexA), FatBoundsOf(World, IndexB)))
+            {
+                body_pair* Pair = AllocStruct(TArena, body_pair);
+                Pair->A = IndexA;
+                Pair->B = IndexB;
+            }
+        }
+    }
+    EndSpan(Pairs, TArena);
+    
+    return Pairs;
+}
+
+static span<body_pair>
+FindCandidatePairs(map_desc* Map, memory_arena* TArena)
+{
+    broadphase* Broadphase = &Map->Broadphase;
+    static_geometry* Statics = &Map->StaticGeometry;
+    physics_world* World = &Map->Physics;
+    
+    span<body_pair> Pairs = {};
+    switch (Broadphase->Mode)
+    {
+        case Broadphase_Grid: Pairs = FindGridPairs(Broadphase, Statics, World, ToSpan(Map->RigidBodies), TArena); break;
+        case Broadphase_SweepAndPrune: Pairs = FindSweepAndPrunePairs(Broadphase, Statics, World, TArena); break;
+        case Broadphase_BruteForce: Pairs = FindBruteForcePairs(World, TArena); break;
+        default: Assert(0);
+    }
+    
+#if DEBUG
+    for (body_pair Pair : Pairs)
+    {
+        Assert(IsDynamic(World, Pair.A) || IsDynamic(World, Pair.B));
+    }
+#endif
+    
+    //Resolve in the same order as the brute force loop
+    qsort(Pairs.Memory, Pairs.Count, sizeof(body_pair), ComparePairs);
+    
+    return Pairs;
+}
+
+struct contact
+{
+    u32 PairIndex;
+    u32 A, B;
+    v2 Normal; //Normal is from A to B
+    f32 Penetration;
+    
+    //Filled in by the solver, the kernels leave these zeroed
+    bool Active;
+    f32 Impulse;
+};
+
+//Pair data gathered into structure-of-arrays form, padded to a multiple of 8 entries
+struct aabb_soa
+{
+    f32* MinX;
+    f32* MinY;
+    f32* MaxX;
+    f32* MaxY;
+};
+
+struct circle_soa
+{
+    f32* X;
+    f32* Y;
+    f32* Radius;
+};
+
+static aabb_soa
+AllocAABBs(memory_arena* Arena, u32 Count)
+{
+    aabb_soa Result = {};
+    Result.MinX = AllocArray(Arena, f32, Count);
+    Result.MinY = AllocArray(Arena, f32, Count);
+    Result.MaxX = AllocArray(Arena, f32, Count);
+    Result.MaxY = AllocArray(Arena, f32, Count);
+    return Result;
+}
+
+static circle_soa
+AllocCircles(memory_arena* Arena, u32 Count)
+{
+    circle_soa Result = {};
+    Result.X = AllocArray(Arena, f32, Count);
+    Result.Y = AllocArray(Arena, f32, Count);
+    Result.Radius = AllocArray(Arena, f32, Count);
+    return Result;
+}
+
+static inline void
+SetAABB(aabb_soa* SoA, u32 Index, rect Rect)
+{
+    SoA->MinX[Index] = Rect.MinCorner.X;
+    SoA->MinY[Index] = Rect.MinCorner.Y;
+    SoA->MaxX[Index] = Rect.MaxCorner.X;
+    SoA->MaxY[Index] = Rect.MaxCorner.Y;
+}
+
+static inline rect
+GetAABB(aabb_soa SoA, u32 Index)
+{
+    rect Result = {{SoA.MinX[Index], SoA.MinY[Index]}, {SoA.MaxX[Index], SoA.MaxY[Index]}};
+    return Result;
+}
+
+static inline void
+SetCircle(circle_soa* SoA, u32 Index, v2 P, f32 Radius)
+{
+    SoA->X[Index] = P.X;
+    SoA->Y[Index] = P.Y;
+    SoA->Radius[Index] = Radius;
+}
+
+static inline u32
+EmitContacts(contact* Contacts, u32 ContactCount, u32* PairIndices, u32 Base, u32 Count, 
+             u32 Width, int Mask, f32* NormalX, f32* NormalY, f32* Penetration)
+{
+    for (u32 Lane = 0; Lane < Width; Lane++)
+    {
+        if ((Mask & (1 << Lane)) && Base + Lane < Count)
+        {
+            contact* Contact = Contacts + ContactCount++;
+            Contact->PairIndex = PairIndices[Base + Lane];
+            Contact->Normal = V2(NormalX[Lane], NormalY[Lane]);
+            Contact->Penetration = Penetration[Lane];
+        }
+    }
+    return ContactCount;
+}
+
+//
+//Scalar kernels, these define the results the wide kernels have to match exactly
+//
+
+static u32
+AABBAABBContactsScalar(u32 Count, aabb_soa A, aabb_soa B, u32* PairIndices, contact* Contacts)
+{
+    u32 ContactCount = 0;
+    for (u32 Index = 0; Index < Count; Index++)
+    {
+        collision Collision = TestAABBAABBCollision(GetAABB(A, Index), GetAABB(B, Index));
+        int Mask = Collision.DidCollide ? 1 : 0;
+        ContactCount = EmitContacts(Contacts, ContactCount, PairIndices, Index, Count, 1, Mask,
+                                    &Collision.Normal.X, &Collision.Normal.Y, &Collision.Penetration);
+    }
+    return ContactCount;
+}
+
+static u32
+AABBCircleContactsScalar(u32 Count, aabb_soa A, circle_soa B, u32* PairIndices, contact* Contacts)
+{
+    u32 ContactCount = 0;
+    for (u32 Index = 0; Index < Count; Index++)
+    {
+        collision Collision = TestAABBCircleCollision(GetAABB(A, Index), V2(B.X[Index], B.Y[Index]), B.Radius[Index]);
+        int Mask = Collision.DidCollide ? 1 : 0;
+        ContactCount = EmitContacts(Contacts, ContactCount, PairIndices, Index, Count, 1, Mask,
+                                    &Collision.Normal.X, &Collision.Normal.Y, &Collision.Penetration);
+    }
+    return ContactCount;
+}
+
+static u32
+CircleCircleContactsScalar(u32 Count, circle_soa A, circle_soa B, u32* PairIndices, contact* Contacts)
+{
+    u32 ContactCount = 0;
+    for (u32 Index = 0; Index < Count; Index++)
+    {
+        collision Collision = TestCircleCircleCollision(V2(A.X[Index], A.Y[Index]), A.Radius[Index], 
+                                                        V2(B.X[Index], B.Y[Index]), B.Radius[Index]);
+        int Mask = Collision.DidCollide ? 1 : 0;
+        ContactCount = EmitContacts(Contacts, ContactCount, PairIndices, Index, Count, 1, Mask,
+                                    &Collision.Normal.X, &Collision.Normal.Y, &Collision.Penetration);
+    }
+    return ContactCount;
+}
+
+//
+//SSE2 kernels, 4 pairs at a time
+//
+
+static inline __m128
+Select4(__m128 A, __m128 B, __m128 Mask)
+{
+    return _mm_or_ps(_mm_and_ps(Mask, B), _mm_andnot_ps(Mask, A));
+}
+
+static u32
+AABBAABBContactsSSE2(u32 Count, aabb_soa A, aabb_soa B, u32* PairIndices, contact* Contacts)
+{
+    u32 ContactCount = 0;
+    for (u32 Index = 0; Index < Count; Index += 4)
+    {
+        __m128 AMinX = _mm_loadu_ps(A.MinX + Index);
+        __m128 AMinY = _mm_loadu_ps(A.MinY + Index);
+        __m128 AMaxX = _mm_loadu_ps(A.MaxX + Index);
+        __m128 AMaxY = _mm_loadu_ps(A.MaxY + Index);
+        __m128 BMinX = _mm_loadu_ps(B.MinX + Index);
+        __m128 BMinY = _mm_loadu_ps(B.MinY + Index);
+        __m128 BMaxX = _mm_loadu_ps(B.MaxX + Index);
+        __m128 BMaxY = _mm_loadu_ps(B.MaxY + Index);
+        
+        __m128 Collide = _mm_and_ps(_mm_and_ps(_mm_cmplt_ps(AMinX, BMaxX), _mm_cmplt_ps(BMinX, AMaxX)),
+                                    _mm_and_ps(_mm_cmplt_ps(AMinY, BMaxY), _mm_cmplt_ps(BMinY, AMaxY)));
+        
+        int Mask = _mm_movemask_ps(Collide);
+        if (Mask)
+        {
+            __m128 Distances[] = {
+                _mm_sub_ps(BMaxX, AMinX),
+                _mm_sub_ps(AMaxX, BMinX),
+                _mm_sub_ps(BMaxY, AMinY),
+                _mm_sub_ps(AMaxY, BMinY)
+            };
+            f32 SidesX[] = {-1.0f, 1.0f, 0.0f, 0.0f};
+            f32 SidesY[] = {0.0f, 0.0f, -1.0f, 1.0f};
+            
+            __m128 Penetration = _mm_set1_ps(1000.0f);
+            __m128 NormalX = _mm_setzero_ps();
+            __m128 NormalY = _mm_setzero_ps();
+            for (int Side = 0; Side < 4; Side++)
+            {
+                __m128 Closer = _mm_cmplt_ps(Distances[Side], Penetration);
+                Penetration = Select4(Penetration, Distances[Side], Closer);
+                NormalX = Select4(NormalX, _mm_set1_ps(SidesX[Side]), Closer);
+                NormalY = Select4(NormalY, _mm_set1_ps(SidesY[Side]), Closer);
+            }
+            
+            f32 OutNormalX[4], OutNormalY[4], OutPenetration[4];
+            _mm_storeu_ps(OutNormalX, NormalX);
+            _mm_storeu_ps(OutNormalY, NormalY);
+            _mm_storeu_ps(OutPenetration, Penetration);
+            ContactCount = EmitContacts(Contacts, ContactCount, PairIndices, Index, Count, 4, Mask, 
+                                        OutNormalX, OutNormalY, OutPenetration);
+        }
+    }
+    return ContactCount;
+}
+
+static inline void
+UnitNormalAndDistance4(__m128 DirectionX, __m128 DirectionY, __m128* NormalX, __m128* NormalY, __m128* Dist)
+{
+    *Dist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(DirectionX, DirectionX), _mm_mul_ps(DirectionY, DirectionY)));
+    
+    //Matches UnitV(), a zero vector stays zero
+    __m128 NonZero = _mm_cmpneq_ps(*Dist, _mm_setzero_ps());
+    *NormalX = _mm_and_ps(NonZero, _mm_div_ps(DirectionX, *Dist));
+    *NormalY = _mm_and_ps(NonZero, _mm_div_ps(DirectionY, *Dist));
+}
+
+static u32
+AABBCircleContactsSSE2(u32 Count, aabb_soa A, circle_soa B, u32* PairIndices, contact* Contacts)
+{
+    u32 ContactCount = 0;
+    for (u32 Index = 0; Index < Count; Index += 4)
+    {
+        __m128 MinX = _mm_loadu_ps(A.MinX + Index);
+        __m128 MinY = _mm_loadu_ps(A.MinY + Index);
+        __m128 MaxX = _mm_loadu_ps(A.MaxX + Index);
+        __m128 MaxY = _mm_loadu_ps(A.MaxY + Index);
+        __m128 CircleX = _mm_loadu_ps(B.X + Index);
+        __m128 CircleY = _mm_loadu_ps(B.Y + Index);
+        __m128 Radius = _mm_loadu_ps(B.Radius + Index);
+        
+        //Same order of tests as Clamp()
+        __m128 NearestX = Select4(CircleX, MinX, _mm_cmplt_ps(CircleX, MinX));
+        NearestX = Select4(NearestX, MaxX, _mm_cmpgt_ps(CircleX, MaxX));
+        __m128 NearestY = Select4(CircleY, MinY, _mm_cmplt_ps(CircleY, MinY));
+        NearestY = Select4(NearestY, MaxY, _mm_cmpgt_ps(CircleY, MaxY));
+        
+        __m128 NormalX, NormalY, Dist;
+        UnitNormalAndDistance4(_mm_sub_ps(CircleX, NearestX), _mm_sub_ps(CircleY, NearestY), &NormalX, &NormalY, &Dist);
+        
+        int Mask = _mm_movemask_ps(_mm_cmplt_ps(Dist, Radius));
+        if (Mask)
+        {
+            f32 OutNormalX[4], OutNormalY[4], OutPenetration[4];
+            _mm_storeu_ps(OutNormalX, NormalX);
+            _mm_storeu_ps(OutNormalY, NormalY);
+            _mm_storeu_ps(OutPenetration, _mm_sub_ps(Radius, Dist));
+            ContactCount = EmitContacts(Contacts, ContactCount, PairIndices, Index, Count, 4, Mask, 
+                                        OutNormalX, OutNormalY, OutPenetration);
+        }
+    }
+    return ContactCount;
+}
+
+static u32
+CircleCircleContactsSSE2(u32 Count, circle_soa A, circle_soa B, u32* PairIndices, contact* Contacts)
+{
+    u32 ContactCount = 0;
+    for (u32 Index = 0; Index < Count; Index += 4)
+    {
+        __m128 DirectionX = _mm_sub_ps(_mm_loadu_ps(B.X + Index), _mm_loadu_ps(A.X + Index));
+        __m128 DirectionY = _mm_sub_ps(_mm_loadu_ps(B.Y + Index), _mm_loadu_ps(A.Y + Index));
+        __m128 SumOfRadii = _mm_add_ps(_mm_loadu_ps(A.Radius + Index), _mm_loadu_ps(B.Radius + Index));
+        
+        __m128 NormalX, NormalY, Dist;
+        UnitNormalAndDistance4(DirectionX, DirectionY, &NormalX, &NormalY, &Dist);
+        
+        int Mask = _mm_movemask_ps(_mm_cmplt_ps(Dist, SumOfRadii));
+        if (Mask)
+        {
+            f32 OutNormalX[4], OutNormalY[4], OutPenetration[4];
+            _mm_storeu_ps(OutNormalX, NormalX);
+            _mm_storeu_ps(OutNormalY, NormalY);
+            _mm_storeu_ps(OutPenetration, _mm_sub_ps(SumOfRadii, Dist));
+            ContactCount = EmitContacts(Contacts, ContactCount, PairIndices, Index, Count, 4, Mask, 
+                                        OutNormalX, OutNormalY, OutPenetration);
+        }
+    }
+    return ContactCount;
+}
+
+//
+//AVX2 kernels, 8 pairs at a time
+//
+
+TARGET_AVX2 static inline __m256
+Select8(__m256 A, __m256 B, __m256 Mask)
+{
+    return _mm256_blendv_ps(A, B, Mask);
+}
+
+TARGET_AVX2 static u32
+AABBAABBContactsAVX2(u32 Count, aabb_soa A, aabb_soa B, u32* PairIndices, contact* Contacts)
+{
+    u32 ContactCount = 0;
+    for (u32 Index = 0; Index < Count; Index += 8)
+    {
+        __m256 AMinX = _mm256_loadu_ps(A.MinX + Index);
+        __m256 AMinY = _mm256_loadu_ps(A.MinY + Index);
+        __m256 AMaxX = _mm256_loadu_ps(A.MaxX + Index);
+        __m256 AMaxY = _mm256_loadu_ps(A.MaxY + Index);
+        __m256 BMinX = _mm256_loadu_ps(B.MinX + Index);
+        __m256 BMinY = _mm256_loadu_ps(B.MinY + Index);
+        __m256 BMaxX = _mm256_loadu_ps(B.MaxX + Index);
+        __m256 BMaxY = _mm256_loadu_ps(B.MaxY + Index);
+        
+        __m256 Collide = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(AMinX, BMaxX, _CMP_LT_OQ), _mm256_cmp_ps(BMinX, AMaxX, _CMP_LT_OQ)),
+                                       _mm256_and_ps(_mm256_cmp_ps(AMinY, BMaxY, _CMP_LT_OQ), _mm256_cmp_ps(BMinY, AMaxY, _CMP_LT_OQ)));
+        
+        int Mask = _mm256_movemask_ps(Collide);
+        if (Mask)
+        {
+            __m256 Distances[] = {
+                _mm256_sub_ps(BMaxX, AMinX),
+                _mm256_sub_ps(AMaxX, BMinX),
+                _mm256_sub_ps(BMaxY, AMinY),
+                _mm256_sub_ps(AMaxY, BMinY)
+            };
+            f32 SidesX[] = {-1.0f, 1.0f, 0.0f, 0.0f};
+            f32 SidesY[] = {0.0f, 0.0f, -1.0f, 1.0f};
+            
+            __m256 Penetration = _mm256_set1_ps(1000.0f);
+            __m256 NormalX = _mm256_setzero_ps();
+            __m256 NormalY = _mm256_setzero_ps();
+            for (int Side = 0; Side < 4; Side++)
+            {
+                __m256 Closer = _mm256_cmp_ps(Distances[Side], Penetration, _CMP_LT_OQ);
+                Penetration = Select8(Penetration, Distances[Side], Closer);
+                NormalX = Select8(NormalX, _mm256_set1_ps(SidesX[Side]), Closer);
+                NormalY = Select8(NormalY, _mm256_set1_ps(SidesY[Side]), Closer);
+            }
+            
+            f32 OutNormalX[8], OutNormalY[8], OutPenetration[8];
+            _mm256_storeu_ps(OutNormalX, NormalX);
+            _mm256_storeu_ps(OutNormalY, NormalY);
+            _mm256_storeu_ps(OutPenetration, Penetration);
+            ContactCount = EmitContacts(Contacts, ContactCount, PairIndices, Index, Count, 8, Mask, 
+                                        OutNormalX, OutNormalY, OutPenetration);
+        }
+    }
+    return ContactCount;
+}
+
+TARGET_AVX2 static inline void
+UnitNormalAndDistance8(__m256 DirectionX, __m256 DirectionY, __m256* NormalX, __m256* NormalY, __m256* Dist)
+{
+    *Dist = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(DirectionX, DirectionX), _mm256_mul_ps(DirectionY, DirectionY)));
+    
+    //Matches UnitV(), a zero vector stays zero
+    __m256 NonZero = _mm256_cmp_ps(*Dist, _mm256_setzero_ps(), _CMP_NEQ_UQ);
+    *NormalX = _mm256_and_ps(NonZero, _mm256_div_ps(DirectionX, *Dist));
+    *NormalY = _mm256_and_ps(NonZero, _mm256_div_ps(DirectionY, *Dist));
+}
+
+TARGET_AVX2 static u32
+AABBCircleContactsAVX2(u32 Count, aabb_soa A, circle_soa B, u32* PairIndices, contact* Contacts)
+{
+    u32 ContactCount = 0;
+    for (u32 Index = 0; Index < Count; Index += 8)
+    {
+        __m256 MinX = _mm256_loadu_ps(A.MinX + Index);
+        __m256 MinY = _mm256_loadu_ps(A.MinY + Index);
+        __m256 MaxX = _mm256_loadu_ps(A.MaxX + Index);
+        __m256 MaxY = _mm256_loadu_ps(A.MaxY + Index);
+        __m256 CircleX = _mm256_loadu_ps(B.X + Index);
+        __m256 CircleY = _mm256_loadu_ps(B.Y + Index);
+        __m256 Radius = _mm256_loadu_ps(B.Radius + Index);
+        
+        //Same order of tests as Clamp()
+        __m256 NearestX = Select8(CircleX, MinX, _mm256_cmp_ps(CircleX, MinX, _CMP_LT_OQ));
+        NearestX = Select8(NearestX, MaxX, _mm256_cmp_ps(CircleX, MaxX, _CMP_GT_OQ));
+        __m256 NearestY = Select8(CircleY, MinY, _mm256_cmp_ps(CircleY, MinY, _CMP_LT_OQ));
+        NearestY = Select8(NearestY, MaxY, _mm256_cmp_ps(CircleY, MaxY, _CMP_GT_OQ));
+        
+        __m256 NormalX, NormalY, Dist;
+        UnitNormalAndDistance8(_mm256_sub_ps(CircleX, NearestX), _mm256_sub_ps(CircleY, NearestY), &NormalX, &NormalY, &Dist);
+        
+        int Mask = _mm256_movemask_ps(_mm256_cmp_ps(Dist, Radius, _CMP_LT_OQ));
+        if (Mask)
+        {
+            f32 OutNormalX[8], OutNormalY[8], OutPenetration[8];
+            _mm256_storeu_ps(OutNormalX, NormalX);
+            _mm256_storeu_ps(OutNormalY, NormalY);
+            _mm256_storeu_ps(OutPenetration, _mm256_sub_ps(Radius, Dist));
+            ContactCount = EmitContacts(Contacts, ContactCount, PairIndices, Index, Count, 8, Mask, 
+                                        OutNormalX, OutNormalY, OutPenetration);
+        }
+    }
+    return ContactCount;
+}
+
+TARGET_AVX2 static u32
+CircleCircleContactsAVX2(u32 Count, circle_soa A, circle_soa B, u32* PairIndices, contact* Contacts)
+{
+    u32 ContactCount = 0;
+    for (u32 Index = 0; Index < Count; Index += 8)
+    {
+        __m256 DirectionX = _mm256_sub_ps(_mm256_loadu_ps(B.X + Index), _mm256_loadu_ps(A.X + Index));
+        __m256 DirectionY = _mm256_sub_ps(_mm256_loadu_ps(B.Y + Index), _mm256_loadu_ps(A.Y + Index));
+        __m256 SumOfRadii = _mm256_add_ps(_mm256_loadu_ps(A.Radius + Index), _mm256_loadu_ps(B.Radius + Index));
+        
+        __m256 NormalX, NormalY, Dist;
+        UnitNormalAndDistance8(DirectionX, DirectionY, &NormalX, &NormalY, &Dist);
+        
+        int Mask = _mm256_movemask_ps(_mm256_cmp_ps(Dist, SumOfRadii, _CMP_LT_OQ));
+        if (Mask)
+        {
+            f32 OutNormalX[8], OutNormalY[8], OutPenetration[8];
+            _mm256_storeu_ps(OutNormalX, NormalX);
+            _mm256_storeu_ps(OutNormalY, NormalY);
+            _mm256_storeu_ps(OutPenetration, _mm256_sub_ps(SumOfRadii, Dist));
+            ContactCount = EmitContacts(Contacts, ContactCount, PairIndices, Index, Count, 8, Mask, 
+                                        OutNormalX, OutNormalY, OutPenetration);
+        }
+    }
+    return ContactCount;
+}
+
+//
+//Dispatch
+//
+
+typedef u32 aabb_aabb_kernel(u32 Count, aabb_soa A, aabb_soa B, u32* PairIndices, contact* Contacts);
+typedef u32 aabb_circle_kernel(u32 Count, aabb_soa A, circle_soa B, u32* PairIndices, contact* Contacts);
+typedef u32 circle_circle_kernel(u32 Count, circle_soa A, circle_soa B, u32* PairIndices, contact* Contacts);
+
+struct narrowphase_kernels
+{
+    aabb_aabb_kernel* AABBAABB;
+    aabb_circle_kernel* AABBCircle;
+    circle_circle_kernel* CircleCircle;
+};
+
+static narrowphase_kernels
+GetNarrowphaseKernels(simd_level Level)
+{
+    narrowphase_kernels Result = {};
+    switch (Level)
+    {
+        case Simd_Scalar:
+        {
+            Result = {AABBAABBContactsScalar, AABBCircleContactsScalar, CircleCircleContactsScalar};
+        } break;
+        case Simd_SSE2:
+        {
+            Result = {AABBAABBContactsSSE2, AABBCircleContactsSSE2, CircleCircleContactsSSE2};
+        } break;
+        case Simd_AVX2:
+        {
+            Result = {AABBAABBContactsAVX2, AABBCircleContactsAVX2, CircleCircleContactsAVX2};
+        } break;
+        default: Assert(0);
+    }
+    return Result;
+}
+
+struct narrowphase_kernel_check
+{
+    u32 Pairs; //Per shape combination
+    u32 Contacts; //Pairs the scalar kernels found touching
+    u32 Mismatches[3]; //For each wide simd_level, pairs whose contact differs from the scalar kernel's
+};
+
+//Kernel output is in pair order, so each contact can be spread back out to the pair it came from
+static void
+SpreadContacts(contact* Contacts, u32 ContactCount, contact* ByPair, bool* Touching, u32 PairCount)
+{
+    for (u32 Pair = 0; Pair < PairCount; Pair++)
+    {
+        Touching[Pair] = false;
+    }
+    for (u32 Index = 0; Index < ContactCount; Index++)
+    {
+        u32 Pair = Contacts[Index].PairIndex;
+        Assert(Pair < PairCount);
+        ByPair[Pair] = Contacts[Index];
+        Touching[Pair] = true;
+    }
+}
+
+static void
+TallyKernelMismatches(narrowphase_kernel_check* Check, u32 Level, u32 PairCount, 
+                      contact* Contacts, bool* Touching, contact* Expected, bool* ExpectedTouching)
+{
+    for (u32 Pair = 0; Pair < PairCount; Pair++)
+    {
+        bool Differs = (Touching[Pair] != ExpectedTouching[Pair]);
+        if (!Differs && Touching[Pair])
+        {
+            Differs = (memcmp(&Contacts[Pair].Normal, &Expected[Pair].Normal, sizeof(v2)) != 0 ||
+                       memcmp(&Contacts[Pair].Penetration, &Expected[Pair].Penetration, sizeof(f32)) != 0);
+        }
+        Check->Mismatches[Level] += Differs;
+    }
+}
+
+//Runs random pairs of each shape combination through every kernel this CPU can run and compares each pair
+//with the scalar kernels, which only wrap the Test*Collision() functions. Shapes sharing an edge or a
+//centre, circles centred on a box edge and batches that end part way through a register are mixed in.
+static narrowphase_kernel_check
+CheckNarrowphaseKernels(u32 PairCount, u32 Seed, memory_arena* TArena)
+{
+    temporary_memory CheckMemory = BeginTemporaryMemory(TArena);
+    srand(Seed);
+    
+    u32 Padded = PairCount + 7;
+    aabb_soa BoxesA = AllocAABBs(TArena, Padded);
+    aabb_soa BoxesB = AllocAABBs(TArena, Padded);
+    circle_soa CirclesA = AllocCircles(TArena, Padded);
+    circle_soa CirclesB = AllocCircles(TArena, Padded);
+    
+    u32* PairIndices = AllocArray(TArena, u32, Padded);
+    for (u32 Pair = 0; Pair < PairCount; Pair++)
+    {
+        v2 SizeA = V2(RandomBetween(0.01f, 0.1f), RandomBetween(0.01f, 0.1f));
+        v2 SizeB = V2(RandomBetween(0.01f, 0.1f), RandomBetween(0.01f, 0.1f));
+        rect A = {V2(RandomBetween(0.0f, 1.0f), RandomBetween(0.0f, 0.6f))};
+        A.MaxCorner = A.MinCorner + SizeA;
+        rect B = {A.MinCorner + V2(RandomBetween(-0.1f, 0.1f), RandomBetween(-0.1f, 0.1f))};
+        
+        v2 CentreA = 0.5f * (A.MinCorner + A.MaxCorner);
+        v2 CentreB = CentreA + V2(RandomBetween(-0.1f, 0.1f), RandomBetween(-0.1f, 0.1f));
+        f32 RadiusA = RandomBetween(0.005f, 0.05f);
+        f32 RadiusB = RandomBetween(0.005f, 0.05f);
+        
+        switch (Pair % 8)
+        {
+            case 0: B.MinCorner.X = A.MaxCorner.X; CentreB = V2(A.MaxCorner.X, CentreB.Y); break;
+            case 1: B.MinCorner = A.MinCorner; SizeB = SizeA; CentreB = CentreA; break;
+            case 2: CentreB = CentreA + V2(RadiusA + RadiusB, 0.0f); break;
+            case 3: B.MinCorner.Y = A.MaxCorner.Y; CentreB = A.MaxCorner; break;
+        }
+        B.MaxCorner = B.MinCorner + SizeB;
+        
+        //Touching from the other side has to be set after, B.MinCorner + SizeB needn't land on A exactly
+        switch (Pair % 8)
+        {
+            case 4: B.MaxCorner.X = A.MinCorner.X; B.MinCorner.X = A.MinCorner.X - SizeB.X; CentreB = A.MinCorner; break;
+            case 5: B.MaxCorner.Y = A.MinCorner.Y; B.MinCorner.Y = A.MinCorner.Y - SizeB.Y; break;
+        }
+        
+        SetAABB(&BoxesA, Pair, A);
+        SetAABB(&BoxesB, Pair, B);
+        SetCircle(&CirclesA, Pair, CentreA, RadiusA);
+        SetCircle(&CirclesB, Pair, CentreB, RadiusB);
+        PairIndices[Pair] = Pair;
+    }
+    
+    contact* Contacts = AllocArray(TArena, contact, Padded);
+    contact* ByPair = AllocArray(TArena, contact, PairCount);
+    contact* Expected = AllocArray(TArena, contact, PairCount);
+    bool* Touching = AllocArray(TArena, bool, PairCount);
+    bool* ExpectedTouching = AllocArray(TArena, bool, PairCount);
+    
+    //Each batch starts where the last ended, so most don't start on a multiple of 8 either
+    u32* BatchEnds = AllocArray(TArena, u32, PairCount + 1);
+    u32 BatchCount = 0;
+    for (u32 End = 0; End < PairCount; )
+    {
+        End += 1 + rand() % 24;
+        BatchEnds[BatchCount++] = (End < PairCount) ? End : PairCount;
+    }
+    
+    narrowphase_kernel_check Result = {};
+    Result.Pairs = PairCount;
+    
+    for (u32 Shapes = 0; Shapes < 3; Shapes++)
+    {
+        for (u32 Level = Simd_Scalar; Level <= (u32)GlobalMaxSimdLevel; Level++)
+        {
+            narrowphase_kernels Kernels = GetNarrowphaseKernels((simd_level)Level);
+            
+            u32 ContactCount = 0;
+            u32 Start = 0;
+            for (u32 Batch = 0; Batch < BatchCount; Batch++)
+            {
+                u32 Count = BatchEnds[Batch] - Start;
+                aabb_soa BatchBoxesA = {BoxesA.MinX + Start, BoxesA.MinY + Start, BoxesA.MaxX + Start, BoxesA.MaxY + Start};
+                aabb_soa BatchBoxesB = {BoxesB.MinX + Start, BoxesB.MinY + Start, BoxesB.MaxX + Start, BoxesB.MaxY + Start};
+                circle_soa BatchCirclesA = {CirclesA.X + Start, CirclesA.Y + Start, CirclesA.Radius + Start};
+                circle_soa BatchCirclesB = {CirclesB.X + Start, CirclesB.Y + Start, CirclesB.Radius + Start};
+                u32* BatchPairs = PairIndices + Start;
+                contact* BatchContacts = Contacts + ContactCount;
+                
+                switch (Shapes)
+                {
+                    case 0: ContactCount += Kernels.AABBAABB(Count, BatchBoxesA, BatchBoxesB, BatchPairs, BatchContacts); break;
+                    case 1: ContactCount += Kernels.AABBCircle(Count, BatchBoxesA, BatchCirclesB, BatchPairs, BatchContacts); break;
+                    case 2: ContactCount += Kernels.CircleCircle(Count, BatchCirclesA, BatchCirclesB, BatchPairs, BatchContacts); break;
+                }
+                Start = BatchEnds[Batch];
+            }
+            
+            if (Level == Simd_Scalar)
+            {
+                SpreadContacts(Contacts, ContactCount, Expected, ExpectedTouching, PairCount);
+                Result.Contacts += ContactCount;
+            }
+            else
+            {
+                SpreadContacts(Contacts, ContactCount, ByPair, Touching, PairCount);
+                TallyKernelMismatches(&Result, Level, PairCount, ByPair, Touching, Expected, ExpectedTouching);
+            }
+        }
+    }
+    
+    EndTemporaryMemory(CheckMemory);
+    return Result;
+}
+
+#if DEBUG
+static void
+CheckContactsMatch(contact* Contacts, u32 ContactCount, contact* Expected, u32 ExpectedCount)
+{
+    Assert(ContactCount == ExpectedCount);
+    for (u32 Index = 0; Index < ContactCount; Index++)
+    {
+        Assert(memcmp(Contacts + Index, Expected + Index, sizeof(contact)) == 0);
+    }
+}
+#endif
+
+//Contacts from each bucket come out in pair order, so merging the buckets keeps the brute force order
+static u32
+MergeContacts(contact* Out, contact** Buckets, u32* Counts, u32 BucketCount)
+{
+    u32 Cursors[3] = {};
+    Assert(BucketCount <= ArrayCount(Cursors));
+    
+    u32 OutCount = 0;
+    while (true)
+    {
+        u32 Best = BucketCount;
+        for (u32 Bucket = 0; Bucket < BucketCount; Bucket++)
+        {
+            if (Cursors[Bucket] < Counts[Bucket])
+            {
+                if (Best == BucketCount || 
+                    Buckets[Bucket][Cursors[Bucket]].PairIndex < Buckets[Best][Cursors[Best]].PairIndex)
+                {
+                    Best = Bucket;
+                }
+            }
+        }
+        
+        if (Best == BucketCount)
+        {
+            break;
+        }
+        
+        Out[OutCount++] = Buckets[Best][Cursors[Best]++];
+    }
+    return OutCount;
+}
+
+//Pairs are tested with one side grown by this much, so bodies only just apart still get a contact with a
+//negative penetration. Earlier contacts in the same step can push them together before theirs is resolved.
+f32 const ContactMargin = 2.0f * BroadphaseMargin;
+
+static inline rect
+ContactBoundsOf(physics_world* World, u32 BodyIndex)
+{
+    rect Result = RectOf(World, BodyIndex);
+    Result.MinCorner -= V2(ContactMargin, ContactMargin);
+    Result.MaxCorner += V2(ContactMargin, ContactMargin);
+    return Result;
+}
+
+static span<contact>
+FindContacts(physics_world* World, span<rigid_body> RigidBodies, span<body_pair> Pairs, memory_arena* TArena)
+{
+    //Bucket the pairs by shape so each bucket goes through one kernel
+    u32 BucketCounts[3] = {};
+    for (body_pair Pair : Pairs)
+    {
+        u32 Circles = (RigidBodies[Pair.A].Type == RigidBody_Circle) + (RigidBodies[Pair.B].Type == RigidBody_Circle);
+        BucketCounts[Circles]++;
+    }
+    
+    u32 Padded[3];
+    for (u32 Bucket = 0; Bucket < 3; Bucket++)
+    {
+        Padded[Bucket] = (BucketCounts[Bucket] + 7) & ~7u;
+    }
+    
+    aabb_soa BoxBoxA = AllocAABBs(TArena, Padded[0]);
+    aabb_soa BoxBoxB = AllocAABBs(TArena, Padded[0]);
+    aabb_soa BoxCircleA = AllocAABBs(TArena, Padded[1]);
+    circle_soa BoxCircleB = AllocCircles(TArena, Padded[1]);
+    circle_soa CircleCircleA = AllocCircles(TArena, Padded[2]);
+    circle_soa CircleCircleB = AllocCircles(TArena, Padded[2]);
+    
+    u32* PairIndices[3];
+    for (u32 Bucket = 0; Bucket < 3; Bucket++)
+    {
+        PairIndices[Bucket] = AllocArray(TArena, u32, Padded[Bucket]);
+    }
+    
+    u32 Filled[3] = {};
+    for (u32 PairIndex = 0; PairIndex < Pairs.Count; PairIndex++)
+    {
+        u32 A = Pairs[PairIndex].A;
+        u32 B = Pairs[PairIndex].B;
+        bool CircleA = (RigidBodies[A].Type == RigidBody_Circle);
+        bool CircleB = (RigidBodies[B].Type == RigidBody_Circle);
+        
+        if (!CircleA && !CircleB)
+        {
+            SetAABB(&BoxBoxA, Filled[0], RectOf(World, A));
+            SetAABB(&BoxBoxB, Filled[0], ContactBoundsOf(World, B));
+            PairIndices[0][Filled[0]++] = PairIndex;
+        }
+        else if (CircleA && CircleB)
+        {
+            SetCircle(&CircleCircleA, Filled[2], BodyP(World, A), RadiusOf(World, A));
+            SetCircle(&CircleCircleB, Filled[2], BodyP(World, B), RadiusOf(World, B) + ContactMargin);
+            PairIndices[2][Filled[2]++] = PairIndex;
+        }
+        else
+        {
+            u32 Box = CircleA ? B : A;
+            u32 Circle = CircleA ? A : B;
+            SetAABB(&BoxCircleA, Filled[1], RectOf(World, Box));
+            SetCircle(&BoxCircleB, Filled[1], BodyP(World, Circle), RadiusOf(World, Circle) + ContactMargin);
+            PairIndices[1][Filled[1]++] = PairIndex;
+        }
+    }
+    
+    narrowphase_kernels Kernels = GetNarrowphaseKernels(GlobalSimdLevel);
+    
+    contact* BucketContacts[3];
+    u32 ContactCounts[3];
+    for (u32 Bucket = 0; Bucket < 3; Bucket++)
+    {
+        BucketContacts[Bucket] = AllocArray(TArena, contact, BucketCounts[Bucket]);
+    }
+    
+    ContactCounts[0] = Kernels.AABBAABB(BucketCounts[0], BoxBoxA, BoxBoxB, PairIndices[0], BucketContacts[0]);
+    ContactCounts[1] = Kernels.AABBCircle(BucketCounts[1], BoxCircleA, BoxCircleB, PairIndices[1], BucketContacts[1]);
+    ContactCounts[2] = Kernels.CircleCircle(BucketCounts[2], CircleCircleA, CircleCircleB, PairIndices[2], BucketContacts[2]);
+
+#if DEBUG
+    if (GlobalSimdLevel != Simd_Scalar)
+    {
+        narrowphase_kernels Reference = GetNarrowphaseKernels(Simd_Scalar);
+        contact* Expected = AllocArray(TArena, contact, Pairs.Count);
+        
+        u32 ExpectedCount = Reference.AABBAABB(BucketCounts[0], BoxBoxA, BoxBoxB, PairIndices[0], Expected);
+        CheckContactsMatch(BucketContacts[0], ContactCounts[0], Expected, ExpectedCount);
+        ExpectedCount = Reference.AABBCircle(BucketCounts[1], BoxCircleA, BoxCircleB, PairIndices[1], Expected);
+        CheckContactsMatch(BucketContacts[1], ContactCounts[1], Expected, ExpectedCount);
+        ExpectedCount = Reference.CircleCircle(BucketCounts[2], CircleCircleA, CircleCircleB, PairIndices[2], Expected);
+        CheckContactsMatch(BucketContacts[2], ContactCounts[2], Expected, ExpectedCount);
+    }
+#endif
+    
+    u32 ContactCount = ContactCounts[0] + ContactCounts[1] + ContactCounts[2];
+    span<contact> Contacts = AllocSpan(TArena, contact, ContactCount);
+    MergeContacts(Contacts.Memory, BucketContacts, ContactCounts, 3);
+    
+    for (contact& Contact : Contacts)
+    {
+        Contact.A = Pairs[Contact.PairIndex].A;
+        Contact.B = Pairs[Contact.PairIndex].B;
+        Contact.Penetration -= ContactMargin;
+        
+        //The box circle kernel has the box first, flip back if the circle was A
+        if (RigidBodies[Contact.A].Type == RigidBody_Circle && RigidBodies[Contact.B].Type == RigidBody_AABB)
+        {
+            Contact.Normal = -1.0f * Contact.Normal;
+        }
+    }
+    
+    return Contacts;
+}
+
+//Contacts are all found before any are resolved, so Pushed tracks how far each body has moved since.
+//This only corrects positions, contacts still touching afterwards are marked Active for the velocity solver.
+static void
+ResolveContacts(physics_world* World, span<contact> Contacts, span<v2> Pushed)
+{
+    for (contact& Contact : Contacts)
+    {
+        u32 IndexA = Contact.A;
+        u32 IndexB = Contact.B;
+        
+        f32 InvMassA = BodyInvMass(World, IndexA);
+        f32 InvMassB = BodyInvMass(World, IndexB);
+        f32 SumInverseMass = InvMassA + InvMassB;
+        
+        f32 Penetration = Contact.Penetration - DotProduct(Pushed[IndexB] - Pushed[IndexA], Contact.Normal);
+        if (SumInverseMass == 0.0f || Penetration <= 0.0f)
+        {
+            continue;
+        }
+        
+        //Bodies that started apart may have only been pushed together along the normal, not across it
+        if (Contact.Penetration <= 0.0f && !RectanglesCollide(RectOf(World, IndexA), RectOf(World, IndexB)))
+        {
+            continue;
+        }
+        
+        Contact.Active = true;
+        
+        v2 PushA = Contact.Normal * Penetration * (InvMassA / SumInverseMass);
+        v2 PushB = Contact.Normal * Penetration * (InvMassB / SumInverseMass);
+        
+        //Bodies that can't move are shared between islands, so they are never written to
+        if (InvMassA != 0.0f)
+        {
+            BodyP(World, IndexA) -= PushA;
+            Pushed[IndexA] -= PushA;
+        }
+        if (InvMassB != 0.0f)
+        {
+            BodyP(World, IndexB) += PushB;
+            Pushed[IndexB] += PushB;
+        }
+    }
+}
+
+static inline void
+ApplyContactImpulse(physics_world* World, contact* Contact, f32 Impulse)
+{
+    f32 InvMassA = BodyInvMass(World, Contact->A);
+    f32 InvMassB = BodyInvMass(World, Contact->B);
+    
+    if (InvMassA != 0.0f)
+    {
+        BodydP(World, Contact->A) -= Contact->Normal * (Impulse * InvMassA);
+    }
+    if (InvMassB != 0.0f)
+    {
+        BodydP(World, Contact->B) += Contact->Normal * (Impulse * InvMassB);
+    }
+}
+
+static inline u32
+ContactHash(u32 IndexA, u32 IndexB)
+{
+    u32 Result = (IndexA * 73856093u) ^ (IndexB * 19349663u);
+    return Result;
+}
+
+static cached_contact*
+FindCachedContact(contact_cache* Cache, u32 IndexA, u32 IndexB)
+{
+    u32 Mask = Cache->Capacity - 1;
+    for (u32 Slot = ContactHash(IndexA, IndexB) & Mask; ; Slot = (Slot + 1) & Mask)
+    {
+        cached_contact* Entry = Cache->Entries + Slot;
+        if (Entry->Stamp != Cache->Stamp)
+        {
+            return 0;
+        }
+        if (Entry->A == IndexA && Entry->B == IndexB)
+        {
+            return Entry;
+        }
+    }
+}
+
+//Empties the cache and fills it with the contacts that ended this step pushing
+static void
+StoreContacts(contact_cache* Cache, span<contact>* ContactLists, u32 ListCount)
+{
+    Cache->Stamp++;
+    Cache->Count = 0;
+    
+    u32 Mask = Cache->Capacity - 1;
+    for (u32 ListIndex = 0; ListIndex < ListCount; ListIndex++)
+    {
+        for (contact Contact : ContactLists[ListIndex])
+        {
+            //Past half full the contact just starts cold next step
+            if (!Contact.Active || Contact.Impulse == 0.0f || 2 * Cache->Count >= Cache->Capacity)
+            {
+                continue;
+            }
+            
+            u32 Slot = ContactHash(Contact.A, Contact.B) & Mask;
+            while (Cache->Entries[Slot].Stamp == Cache->Stamp)
+            {
+                Slot = (Slot + 1) & Mask;
+            }
+            
+            cached_contact* Entry = Cache->Entries + Slot;
+            Entry->A = Contact.A;
+            Entry->B = Contact.B;
+            Entry->Stamp = Cache->Stamp;
+            Entry->Normal = Contact.Normal;
+            Entry->Impulse = Contact.Impulse;
+            Cache->Count++;
+        }
+    }
+}
+
+f32 const WarmStartNormalTolerance = 0.99f; //Cached impulses are only reused if the normal hasn't turned
+
+//Starts each contact from the impulse the same pair ended the last step with, which resting contacts mostly
+//need again. Returns how many contacts were warm started.
+static u32
+WarmStartContacts(physics_world* World, span<contact> Contacts)
+{
+    u32 Result = 0;
+    for (contact& Contact : Contacts)
+    {
+        if (!Contact.Active)
+        {
+            continue;
+        }
+        
+        cached_contact* Cached = FindCachedContact(&World->ContactCache, Contact.A, Contact.B);
+        if (Cached && DotProduct(Cached->Normal, Contact.Normal) >= WarmStartNormalTolerance)
+        {
+            Contact.Impulse = Cached->Impulse;
+            ApplyContactImpulse(World, &Contact, Contact.Impulse);
+            Result++;
+        }
+    }
+    return Result;
+}
+
+f32 const SolverTolerance = 0.0001f; //Largest velocity change in a pass for the contacts to count as settled
+
+//Sequential impulses, each contact's total impulse is kept so a later pass can take back some of what an
+//earlier one applied, but never enough to pull the bodies together. Returns the number of passes.
+static u32
+SolveContactVelocities(physics_world* World, span<contact> Contacts, u32 MaxIterations)
+{
+    u32 Iteration = 0;
+    while (Iteration < MaxIterations)
+    {
+        Iteration++;
+        
+        f32 LargestChange = 0.0f;
+        for (contact& Contact : Contacts)
+        {
+            if (!Contact.Active)
+            {
+                continue;
+            }
+            
+            f32 SumInverseMass = BodyInvMass(World, Contact.A) + BodyInvMass(World, Contact.B);
+            
+            v2 VelContact = BodydP(World, Contact.B) - BodydP(World, Contact.A);
+            f32 CoefficientOfRestitution = 0.0f;
+            
+            f32 ImpulseForce = DotProduct(VelContact, Contact.Normal);
+            
+            f32 j = (-(1.0f + CoefficientOfRestitution) * ImpulseForce) / (SumInverseMass);
+            
+            f32 OldImpulse = Contact.Impulse;
+            Contact.Impulse = Max(OldImpulse + j, 0.0f);
+            j = Contact.Impulse - OldImpulse;
+            
+            ApplyContactImpulse(World, &Contact, j);
+            LargestChange = Max(LargestChange, Abs(j) * SumInverseMass);
+        }
+        
+        if (LargestChange < SolverTolerance)
+        {
+            break;
+        }
+    }
+    return Iteration;
+}
+
+static void
+ResolveCollision(physics_world* World, span<rigid_body> RigidBodies, u32 IndexA, u32 IndexB)
+{
+    rigid_body_type TypeA = RigidBodies[IndexA].Type;
+    rigid_body_type TypeB = RigidBodies[IndexB].Type;
+    
+    collision Collision = {};
+    if (TypeA == RigidBody_AABB && TypeB == RigidBody_AABB)
+    {
+        Collision = TestAABBAABBCollision(RectOf(World, IndexA), RectOf(World, IndexB));
+    }
+    if (TypeA == RigidBody_AABB && TypeB == RigidBody_Circle)
+    {
+        Collision = TestAABBCircleCollision(RectOf(World, IndexA), BodyP(World, IndexB), RadiusOf(World, IndexB));
+    }
+    if (TypeA == RigidBody_Circle && TypeB == RigidBody_AABB)
+    {
+        Collision = TestAABBCircleCollision(RectOf(World, IndexB), BodyP(World, IndexA), RadiusOf(World, IndexA));
+        Collision.Normal = -1.0f * Collision.Normal;
+    }
+    if (TypeA == RigidBody_Circle && TypeB == RigidBody_Circle)
+    {
+        Collision = TestCircleCircleCollision(BodyP(World, IndexA), RadiusOf(World, IndexA), BodyP(World, IndexB), RadiusOf(World, IndexB));
+    }
+    
+    if (Collision.DidCollide)
+    {
+        f32 InvMassA = BodyInvMass(World, IndexA);
+        f32 InvMassB = BodyInvMass(World, IndexB);
+        f32 SumInverseMass = InvMassA + InvMassB;
+        
+        if (SumInverseMass == 0.0f)
+        {
+            return;
+        }
+        
+        BodyP(World, IndexA) -= Collision.Normal * Collision.Penetration * (InvMassA / SumInverseMass);
+        BodyP(World, IndexB) += Collision.Normal * Collision.Penetration * (InvMassB / SumInverseMass);
+        
+        v2 VelContact = BodydP(World, IndexB) - BodydP(World, IndexA);
+        f32 CoefficientOfRestitution = 0.0f;
+        
+        f32 ImpulseForce = DotProduct(VelContact, Collision.Normal);
+        
+        f32 j = (-(1.0f + CoefficientOfRestitution) * ImpulseForce) / (SumInverseMass);
+        
+        v2 Impulse = Collision.Normal * j;
+        
+        BodydP(World, IndexA) -= Impulse * InvMassA;
+        BodydP(World, IndexB) += Impulse * InvMassB;
+    }
+}
+
+f32 const SleepVelocity = 0.01f;
+f32 const TimeToSleep = 0.5f;
+f32 const SleepMoveTolerance = 0.0001f; //Kinematic bodies easing towards a target keep creeping for a long time
+f32 const IslandContactSlop = 0.001f; //Resting bodies end each step just touching, candidate pairs further apart than this are not in contact
+
+static u32
+FindIslandRoot(u32* Parent, u32 BodyIndex)
+{
+    while (Parent[BodyIndex] != BodyIndex)
+    {
+        Parent[BodyIndex] = Parent[Parent[BodyIndex]];
+        BodyIndex = Parent[BodyIndex];
+    }
+    return BodyIndex;
+}
+
+//The lower root always wins, so every island is named after its lowest body index
+static void
+JoinIslands(u32* Parent, u32 IndexA, u32 IndexB)
+{
+    u32 RootA = FindIslandRoot(Parent, IndexA);
+    u32 RootB = FindIslandRoot(Parent, IndexB);
+    if (RootA < RootB)
+    {
+        Parent[RootB] = RootA;
+    }
+    else if (RootB < RootA)
+    {
+        Parent[RootA] = RootB;
+    }
+}
+
+static bool
+InContact(physics_world* World, u32 IndexA, u32 IndexB)
+{
+    rect BoundsA = RectOf(World, IndexA);
+    BoundsA.MinCorner -= V2(IslandContactSlop, IslandContactSlop);
+    BoundsA.MaxCorner += V2(IslandContactSlop, IslandContactSlop);
+    
+    return RectanglesCollide(BoundsA, RectOf(World, IndexB));
+}
+
+//Islands join dynamic bodies through their contacts, static and kinematic bodies don't link islands together
+static u32*
+FindIslands(physics_world* World, span<body_pair> Pairs, memory_arena* TArena)
+{
+    u32* Parent = AllocArray(TArena, u32, World->BodyCount);
+    for (u32 BodyIndex = 0; BodyIndex < World->BodyCount; BodyIndex++)
+    {
+        Parent[BodyIndex] = BodyIndex;
+    }
+    
+    for (body_pair Pair : Pairs)
+    {
+        if (IsDynamic(World, Pair.A) && IsDynamic(World, Pair.B) && InContact(World, Pair.A, Pair.B))
+        {
+            JoinIslands(Parent, Pair.A, Pair.B);
+        }
+    }
+    
+    for (u32 BodyIndex = 0; BodyIndex < World->BodyCount; BodyIndex++)
+    {
+        FindIslandRoot(Parent, BodyIndex);
+    }
+    return Parent;
+}
+
+static void
+WakeIsland(physics_world* World, u32 BodyIndex)
+{
+    if (IsAwake(World, BodyIndex) || !IsDynamic(World, BodyIndex))
+    {
+        return;
+    }
+    
+    u32 Next = World->SleepIsland[BodyIndex] + 1;
+    while (Next)
+    {
+        u32 OtherIndex = Next - 1;
+        World->Awake[OtherIndex] = true;
+        World->RestingTime[OtherIndex] = 0.0f;
+        Next = World->NextInIsland[OtherIndex];
+    }
+    World->SleepingChanged = true;
+}
+
+static bool
+MovedSinceLastStep(physics_world* World, u32 BodyIndex)
+{
+    rect Bounds = RectOf(World, BodyIndex);
+    rect LastBounds = World->LastBounds[BodyIndex];
+    
+    v2 MinDelta = Bounds.MinCorner - LastBounds.MinCorner;
+    v2 MaxDelta = Bounds.MaxCorner - LastBounds.MaxCorner;
+    f32 Moved = Max(Max(Abs(MinDelta.X), Abs(MinDelta.Y)), Max(Abs(MaxDelta.X), Abs(MaxDelta.Y)));
+    
+    return Moved > SleepMoveTolerance;
+}
+
+//Wakes the sleeping islands of every body within the slop of everywhere a kinematic body was between two steps.
+//A body that moves away from what rests on it is already out of contact by the time the pairs are tested.
+//Bodies woken since the sleeping grid was built are still in it, so they're skipped here.
+static void
+WakeIslandsAlongMove(broadphase_grid* SleepingGrid, physics_world* World, u32 MovedIndex)
+{
+    rect LastBounds = World->LastBounds[MovedIndex];
+    rect Bounds = RectOf(World, MovedIndex);
+    
+    rect Swept = {};
+    Swept.MinCorner = V2(Min(LastBounds.MinCorner.X, Bounds.MinCorner.X), Min(LastBounds.MinCorner.Y, Bounds.MinCorner.Y));
+    Swept.MaxCorner = V2(Max(LastBounds.MaxCorner.X, Bounds.MaxCorner.X), Max(LastBounds.MaxCorner.Y, Bounds.MaxCorner.Y));
+    Swept.MinCorner -= V2(IslandContactSlop, IslandContactSlop);
+    Swept.MaxCorner += V2(IslandContactSlop, IslandContactSlop);
+    
+    broadphase_grid* Grid = SleepingGrid;
+    for (i32 CellY = CellOf(Grid->CellSize, Swept.MinCorner.Y); CellY <= CellOf(Grid->CellSize, Swept.MaxCorner.Y); CellY++)
+    {
+        for (i32 CellX = CellOf(Grid->CellSize, Swept.MinCorner.X); CellX <= CellOf(Grid->CellSize, Swept.MaxCorner.X); CellX++)
+        {
+            u32 EntryIndex = Grid->Buckets[CellHash(CellX, CellY) & (Grid->BucketCount - 1)];
+            while (EntryIndex)
+            {
+                broadphase_entry* Entry = Grid->Entries + (EntryIndex - 1);
+                EntryIndex = Entry->Next;
+                
+                u32 OtherIndex = Entry->Index;
+                if (Entry->CellX == CellX && Entry->CellY == CellY && 
+                    IsSleeping(World, OtherIndex) && RectanglesCollide(Swept, RectOf(World, OtherIndex)))
+                {
+                    WakeIsland(World, OtherIndex);
+                }
+            }
+        }
+    }
+}
+
+//Wakes the islands of bodies the game moved since the last step, and works out which kinematic bodies are moving
+static void
+WakeMovedBodies(map_desc* Map, u32 ControllingIndex)
+{
+    physics_world* World = &Map->Physics;
+    span<rigid_body> RigidBodies = ToSpan(Map->RigidBodies);
+    
+    UpdateSleepingGrid(&Map->Broadphase, World);
+    
+    for (u32 BodyIndex = 0; BodyIndex < World->BodyCount; BodyIndex++)
+    {
+        bool Moved = MovedSinceLastStep(World, BodyIndex);
+        
+        if (RigidBodies[BodyIndex].Static)
+        {
+            World->Awake[BodyIndex] = false;
+        }
+        else if (!IsDynamic(World, BodyIndex))
+        {
+            //Activated and attached bodies are moved by the game, not the solver
+            World->Awake[BodyIndex] = Moved || !World->SleepingEnabled;
+            if (Moved)
+            {
+                WakeIslandsAlongMove(&Map->Broadphase.SleepingGrid, World, BodyIndex);
+            }
+        }
+        else if (Moved || BodyIndex == ControllingIndex || !World->SleepingEnabled)
+        {
+            WakeIsland(World, BodyIndex);
+        }
+        
+        World->LastBounds[BodyIndex] = RectOf(World, BodyIndex);
+    }
+}
+
+//Wakes every sleeping island an awake body has run into. Pairs between two bodies woken here are only
+//found on the next step, they were resting against each other anyway.
+static void
+WakeTouchedIslands(physics_world* World, span<body_pair> Pairs)
+{
+    for (body_pair Pair : Pairs)
+    {
+        if (!InContact(World, Pair.A, Pair.B))
+        {
+            continue;
+        }
+        
+        if (IsAwake(World, Pair.A))
+        {
+            WakeIsland(World, Pair.B);
+        }
+        if (IsAwake(World, Pair.B))
+        {
+            WakeIsland(World, Pair.A);
+        }
+    }
+}
+
+static void
+PutRestingIslandsToSleep(map_desc* Map, span<body_pair> Pairs, f32 DeltaTime, u32 ControllingIndex, memory_arena* TArena)
+{
+    physics_world* World = &Map->Physics;
+    physics_stats* Stats = &Map->Broadphase.Stats;
+    
+    for (u32 BodyIndex = 0; BodyIndex < World->BodyCount; BodyIndex++)
+    {
+        if (IsDynamic(World, BodyIndex) && IsAwake(World, BodyIndex))
+        {
+            //Stacked bodies keep some velocity into each other every step, so rest is judged on how far they actually moved
+            rect LastBounds = World->LastBounds[BodyIndex];
+            v2 Moved = BodyP(World, BodyIndex) - 0.5f * (LastBounds.MinCorner + LastBounds.MaxCorner);
+            bool Resting = (LengthSq(Moved) < Square(SleepVelocity * DeltaTime)) && BodyIndex != ControllingIndex;
+            World->RestingTime[BodyIndex] = Resting ? World->RestingTime[BodyIndex] + DeltaTime : 0.0f;
+        }
+    }
+    
+    u32* Island = FindIslands(World, Pairs, TArena);
+    
+    //An island only sleeps once every body in it has rested long enough
+    f32* IslandRestingTime = AllocArray(TArena, f32, World->BodyCount);
+    for (u32 BodyIndex = 0; BodyIndex < World->BodyCount; BodyIndex++)
+    {
+        IslandRestingTime[BodyIndex] = TimeToSleep;
+    }
+    
+    for (u32 BodyIndex = 0; BodyIndex < World->BodyCount; BodyIndex++)
+    {
+        if (IsDynamic(World, BodyIndex) && IsAwake(World, BodyIndex))
+        {
+            f32* RestingTime = IslandRestingTime + Island[BodyIndex];
+            *RestingTime = Min(*RestingTime, World->RestingTime[BodyIndex]);
+            
+            if (Island[BodyIndex] == BodyIndex)
+            {
+                Stats->IslandCount++;
+            }
+        }
+    }
+    
+    //Bodies are listed under the lowest one falling asleep with them, so waking the island doesn't search for them
+    u32* FirstAsleep = AllocArray(TArena, u32, World->BodyCount);
+    for (u32 BodyIndex = 0; BodyIndex < World->BodyCount; BodyIndex++)
+    {
+        if (IsDynamic(World, BodyIndex) && IsAwake(World, BodyIndex) && World->SleepingEnabled && 
+            IslandRestingTime[Island[BodyIndex]] >= TimeToSleep)
+        {
+            u32* First = FirstAsleep + Island[BodyIndex];
+            if (*First)
+            {
+                u32 Head = *First - 1;
+                World->SleepIsland[BodyIndex] = Head;
+                World->NextInIsland[BodyIndex] = World->NextInIsland[Head];
+                World->NextInIsland[Head] = BodyIndex + 1;
+            }
+            else
+            {
+                *First = BodyIndex + 1;
+                World->SleepIsland[BodyIndex] = BodyIndex;
+                World->NextInIsland[BodyIndex] = 0;
+            }
+            
+            World->Awake[BodyIndex] = false;
+            BodydP(World, BodyIndex) = V2(0.0f, 0.0f);
+            World->SleepingChanged = true;
+        }
+        
+        if (IsDynamic(World, BodyIndex))
+        {
+            if (IsAwake(World, BodyIndex))
+                Stats->AwakeBodies++;
+            else
+                Stats->SleepingBodies++;
+        }
+    }
+}
+
+struct island_job
+{
+    physics_world* World;
+    span<rigid_body> RigidBodies;
+    span<body_pair> Pairs;
+    span<v2> Pushed;
+    memory_arena Arena;
+    
+    span<contact> Contacts;
+    u32 WarmStartedContacts;
+    u32 Iterations;
+    f32 DeepestPenetration;
+};
+
+//Upper bound on what FindContacts() allocates for a batch of pairs
+static u64
+IslandJobArenaSize(u32 PairCount)
+{
+    u64 Result = (u64)PairCount * (3 * sizeof(contact) + 2 * sizeof(f32) * 4 + sizeof(u32)) + Kilobytes(4);
+    return Result;
+}
+
+static void
+SolveIslandJob(void* Data)
+{
+    island_job* Job = (island_job*)Data;
+    
+    physics_world* World = Job->World;
+    
+    Job->Contacts = FindContacts(World, Job->RigidBodies, Job->Pairs, &Job->Arena);
+    ResolveContacts(World, Job->Contacts, Job->Pushed);
+    
+    for (contact Contact : Job->Contacts)
+    {
+        Job->DeepestPenetration = Max(Job->DeepestPenetration, Contact.Penetration);
+    }
+    
+    if (World->WarmStarting)
+    {
+        Job->WarmStartedContacts = WarmStartContacts(World, Job->Contacts);
+    }
+    Job->Iterations = SolveContactVelocities(World, Job->Contacts, World->VelocityIterations);
+}
+
+//Islands never share a dynamic body and static or kinematic bodies are never written to, so islands can be
+//solved on different threads. Each island still sees its contacts in the same order as one solve over every
+//pair would, so the result is the same whatever the thread count.
+static void
+SolveIslands(physics_world* World, span<rigid_body> RigidBodies, span<body_pair> Pairs, physics_stats* Stats, memory_arena* TArena)
+{
+    u32* Parent = AllocArray(TArena, u32, World->BodyCount);
+    for (u32 BodyIndex = 0; BodyIndex < World->BodyCount; BodyIndex++)
+    {
+        Parent[BodyIndex] = BodyIndex;
+    }
+    
+    for (body_pair Pair : Pairs)
+    {
+        if (IsDynamic(World, Pair.A) && IsDynamic(World, Pair.B))
+        {
+            JoinIslands(Parent, Pair.A, Pair.B);
+        }
+    }
+    
+    //Counting sort of the pairs by island, every pair has a dynamic body to file it under
+    u32* PairIsland = AllocArray(TArena, u32, Pairs.Count);
+    u32* IslandStart = AllocArray(TArena, u32, World->BodyCount + 1);
+    for (u32 PairIndex = 0; PairIndex < Pairs.Count; PairIndex++)
+    {
+        body_pair Pair = Pairs[PairIndex];
+        PairIsland[PairIndex] = FindIslandRoot(Parent, IsDynamic(World, Pair.A) ? Pair.A : Pair.B);
+        IslandStart[PairIsland[PairIndex] + 1]++;
+    }
+    
+    for (u32 Island = 0; Island < World->BodyCount; Island++)
+    {
+        IslandStart[Island + 1] += IslandStart[Island];
+    }
+    
+    u32* Cursor = AllocArray(TArena, u32, World->BodyCount);
+    memcpy(Cursor, IslandStart, World->BodyCount * sizeof(u32));
+    
+    span<body_pair> SortedPairs = AllocSpan(TArena, body_pair, Pairs.Count);
+    for (u32 PairIndex = 0; PairIndex < Pairs.Count; PairIndex++)
+    {
+        SortedPairs[Cursor[PairIsland[PairIndex]]++] = Pairs[PairIndex];
+    }
+    
+    //Small islands are batched so each job is worth handing out, the batches only depend on the pairs
+    u32 const MaxJobCount = 64;
+    u32 const MinPairsPerJob = 64;
+    u32 PairsPerJob = (Pairs.Count + MaxJobCount - 1) / MaxJobCount;
+    PairsPerJob = (PairsPerJob < MinPairsPerJob) ? MinPairsPerJob : PairsPerJob;
+    
+    island_job* Jobs = AllocArray(TArena, island_job, MaxJobCount + 1);
+    u32 JobCount = 0;
+    
+    span<v2> Pushed = AllocSpan(TArena, v2, World->BodyCount);
+    
+    u32 JobStart = 0;
+    for (u32 Island = 0; Island < World->BodyCount; Island++)
+    {
+        u32 JobEnd = IslandStart[Island + 1];
+        bool LastIsland = (Island + 1 == World->BodyCount);
+        
+        if ((JobEnd - JobStart >= PairsPerJob) || (LastIsland && JobEnd > JobStart))
+        {
+            Assert(JobCount <= MaxJobCount);
+            island_job* Job = Jobs + JobCount++;
+            Job->World = World;
+            Job->RigidBodies = RigidBodies;
+            Job->Pairs = {SortedPairs.Memory + JobStart, JobEnd - JobStart};
+            Job->Pushed = Pushed;
+            Job->Arena = CreateSubArena(TArena, IslandJobArenaSize(Job->Pairs.Count));
+            JobStart = JobEnd;
+        }
+    }
+    
+    bool Threaded = World->Multithreaded && GlobalWorkQueue && JobCount > 1;
+    for (u32 JobIndex = 0; JobIndex < JobCount; JobIndex++)
+    {
+        if (Threaded)
+        {
+            PlatformAddWork(GlobalWorkQueue, SolveIslandJob, Jobs + JobIndex);
+        }
+        else
+        {
+            SolveIslandJob(Jobs + JobIndex);
+        }
+    }
+    
+    if (Threaded)
+    {
+        PlatformCompleteAllWork(GlobalWorkQueue);
+    }
+    
+    //The jobs only read the cache, so it is refilled once they are all done
+    span<contact>* ContactLists = AllocArray(TArena, span<contact>, JobCount);
+    for (u32 JobIndex = 0; JobIndex < JobCount; JobIndex++)
+    {
+        island_job* Job = Jobs + JobIndex;
+        ContactLists[JobIndex] = Job->Contacts;
+        
+        Stats->ContactCount += Job->Contacts.Count;
+        Stats->WarmStartedContacts += Job->WarmStartedContacts;
+        Stats->SolverIterations += Job->Iterations;
+        Stats->DeepestPenetration = Max(Stats->DeepestPenetration, Job->DeepestPenetration);
+    }
+    StoreContacts(&World->ContactCache, ContactLists, JobCount);
+    
+    Stats->SolverJobs = JobCount;
+}
+
+f32 const SweepSkin = 0.0001f; //Swept bodies stop this far short of what they hit
+
+//A body moving more than half its size in one step can end up with its center past the middle of a thin
+//wall, and then the contact solver pushes it out the far side
+static inline bool
+IsFastMoving(physics_world* World, u32 BodyIndex, v2 Delta)
+{
+    v2 HalfSize = 0.5f * BodySize(World, BodyIndex);
+    bool Result = (Abs(Delta.X) > HalfSize.X || Abs(Delta.Y) > HalfSize.Y);
+    return Result;
+}
+
+static time_of_impact
+SweepAgainst(physics_world* World, span<rigid_body> RigidBodies, u32 BodyIndex, v2 Delta, u32 ObstacleIndex)
+{
+    time_of_impact Result = {};
+    
+    //Walls are all boxes, nothing round is ever static or kinematic
+    if (ObstacleIndex != BodyIndex && !IsDynamic(World, ObstacleIndex) && RigidBodies[ObstacleIndex].Type == RigidBody_AABB)
+    {
+        if (RigidBodies[BodyIndex].Type == RigidBody_Circle)
+        {
+            Result = SweptCircleImpact(BodyP(World, BodyIndex), RadiusOf(World, BodyIndex), Delta, RectOf(World, ObstacleIndex));
+        }
+        else
+        {
+            Result = SweptAABBImpact(RectOf(World, BodyIndex), Delta, RectOf(World, ObstacleIndex));
+        }
+    }
+    return Result;
+}
+
+//Earliest hit of a static or kinematic body along Delta. Dynamic bodies get pushed out of the way by the
+//solver, so they aren't swept against.
+static time_of_impact
+SweepBody(map_desc* Map, u32 BodyIndex, v2 Delta)
+{
+    physics_world* World = &Map->Physics;
+    span<rigid_body> RigidBodies = ToSpan(Map->RigidBodies);
+    static_geometry* Statics = &Map->StaticGeometry;
+    broadphase_grid* Grid = &Statics->Grid;
+    
+    rect Start = RectOf(World, BodyIndex);
+    rect Swept = Start;
+    Swept.MinCorner += V2(Min(Delta.X, 0.0f), Min(Delta.Y, 0.0f));
+    Swept.MaxCorner += V2(Max(Delta.X, 0.0f), Max(Delta.Y, 0.0f));
+    
+    time_of_impact Result = {};
+    Result.Time = 1.0f;
+    
+    //A wall spanning several cells is tested once per cell, that only costs time
+    for (i32 CellY = CellOf(Grid->CellSize, Swept.MinCorner.Y); CellY <= CellOf(Grid->CellSize, Swept.MaxCorner.Y); CellY++)
+    {
+        for (i32 CellX = CellOf(Grid->CellSize, Swept.MinCorner.X); CellX <= CellOf(Grid->CellSize, Swept.MaxCorner.X); CellX++)
+        {
+            u32 EntryIndex = Grid->Buckets[CellHash(CellX, CellY) & (Grid->BucketCount - 1)];
+            while (EntryIndex)
+            {
+                broadphase_entry* Entry = Grid->Entries + (EntryIndex - 1);
+                EntryIndex = Entry->Next;
+                
+                if (Entry->CellX != CellX || Entry->CellY != CellY)
+                {
+                    continue;
+                }
+                
+                time_of_impact Impact = SweepAgainst(World, RigidBodies, BodyIndex, Delta, Statics->Bodies[Entry->Index]);
+                if (Impact.DidHit && Impact.Time < Result.Time)
+                {
+                    Result = Impact;
+                }
+            }
+        }
+    }
+    
+    //Kinematic bodies move so they aren't in the grid, but there are only ever a few of them
+    for (u32 OtherIndex : Statics->Kinematic)
+    {
+        if (RectanglesCollide(Swept, RectOf(World, OtherIndex)))
+        {
+            time_of_impact Impact = SweepAgainst(World, RigidBodies, BodyIndex, Delta, OtherIndex);
+            if (Impact.DidHit && Impact.Time < Result.Time)
+            {
+                Result = Impact;
+            }
+        }
+    }
+    
+    return Result;
+}
+
+//Returns how far the body moves this step and updates its velocity. Mask is 0 for sleeping bodies, so they
+//neither move nor speed up.
+static inline v2
+IntegrateVelocity(v2* dP, v2 Accel, f32 Mask, f32 InvMass, f32 TimeStep)
+{
+    v2 ddP = Accel * (Mask * InvMass);
+    v2 Delta = Mask * (TimeStep * *dP + 0.5f * ddP * Square(TimeStep));
+    *dP += TimeStep * ddP;
+    return Delta;
+}
+
+//Advances the simulation by one fixed tick
+static void
+PhysicsUpdate(map_desc* Map, f32 TimeStep, v2 Movement, u32 ControllingIndex, memory_arena* TArena)
+{
+    physics_world* World = &Map->Physics;
+    span<rigid_body> RigidBodies = ToSpan(Map->RigidBodies);
+    broadphase* Broadphase = &Map->Broadphase;
+    
+    Broadphase->Stats = {};
+    
+    WakeMovedBodies(Map, ControllingIndex);
+    
+    v2 Gravity = V2(0.0f, -2.5f);
+    f32 Friction = 10.0f;
+    
+    f32 Speed = 5.0f;
+    v2 ControlAccel = Speed * Movement;
+    
+    v2* P = World->P;
+    v2* dP = World->dP;
+    f32* InvMass = World->InvMass;
+    u32 BodyCount = World->BodyCount;
+    
+    //Sleeping bodies are masked to a zero step rather than skipped, so the integration has no branches
+    f32* AwakeMask = AllocArray(TArena, f32, BodyCount);
+    for (u32 BodyIndex = 0; BodyIndex < BodyCount; BodyIndex++)
+    {
+        AwakeMask[BodyIndex] = World->Awake[BodyIndex] ? 1.0f : 0.0f;
+    }
+    
+    v2 ControlledVelocity = (ControllingIndex < BodyCount) ? dP[ControllingIndex] : V2(0.0f, 0.0f);
+    
+    //A straight stream over every body the compiler can vectorise
+    v2* Deltas = AllocArray(TArena, v2, BodyCount);
+    for (u32 BodyIndex = 0; BodyIndex < BodyCount; BodyIndex++)
+    {
+        v2 Accel = Gravity - Friction * dP[BodyIndex];
+        Deltas[BodyIndex] = IntegrateVelocity(dP + BodyIndex, Accel, AwakeMask[BodyIndex], InvMass[BodyIndex], TimeStep);
+    }
+    
+    //The controlled body again with its control acceleration, so the loop above doesn't test every index for it
+    if (ControllingIndex < BodyCount)
+    {
+        dP[ControllingIndex] = ControlledVelocity;
+        
+        v2 Accel = Gravity - Friction * ControlledVelocity;
+        Accel += ControlAccel;
+        Deltas[ControllingIndex] = IntegrateVelocity(dP + ControllingIndex, Accel, AwakeMask[ControllingIndex], 
+                                                     InvMass[ControllingIndex], TimeStep);
+    }
+    
+    //Only static and kinematic bodies are swept against and they don't move in the step above, so sweeping
+    //afterwards finds the same hits
+    if (World->ContinuousCollision)
+    {
+        for (u32 BodyIndex = 0; BodyIndex < BodyCount; BodyIndex++)
+        {
+            v2 Delta = Deltas[BodyIndex];
+            if (IsDynamic(World, BodyIndex) && IsFastMoving(World, BodyIndex, Delta))
+            {
+                Broadphase->Stats.SweptBodies++;
+                
+                time_of_impact Impact = SweepBody(Map, BodyIndex, Delta);
+                if (Impact.DidHit)
+                {
+                    Broadphase->Stats.SweptHits++;
+                    
+                    //Stop just short and leave the contact to the solver, the rest of this step's motion is dropped
+                    f32 Time = Max(Impact.Time - SweepSkin / Length(Delta), 0.0f);
+                    Deltas[BodyIndex] = Time * Delta;
+                    
+                    f32 IntoObstacle = DotProduct(dP[BodyIndex], Impact.Normal);
+                    if (IntoObstacle < 0.0f)
+                    {
+                        dP[BodyIndex] -= IntoObstacle * Impact.Normal;
+                    }
+                }
+            }
+        }
+    }
+    
+    for (u32 BodyIndex = 0; BodyIndex < BodyCount; BodyIndex++)
+    {
+        P[BodyIndex] += Deltas[BodyIndex];
+    }
+    
+    span<body_pair> Pairs = FindCandidatePairs(Map, TArena);
+    WakeTouchedIslands(World, Pairs);
+    
+    if (Broadphase->Mode == Broadphase_BruteForce)
+    {
+        for (u32 IndexA = 0; IndexA < RigidBodies.Count; IndexA++)
+        {
+            for (u32 IndexB = 0; IndexB < IndexA; IndexB++)
+            {
+                if (ShouldTestPair(World, IndexA, IndexB))
+                {
+                    ResolveCollision(World, RigidBodies, IndexA, IndexB);
+                }
+            }
+        }
+        
+        RecordPairStats(Broadphase, RigidBodies.Count, RigidBodies.Count * (RigidBodies.Count - 1) / 2);
+        
+        //The reference path doesn't keep contacts, don't warm start from stale ones after switching back
+        World->ContactCache.Stamp++;
+    }
+    else
+    {
+        RecordPairStats(Broadphase, RigidBodies.Count, Pairs.Count);
+        SolveIslands(World, RigidBodies, Pairs, &Broadphase->Stats, TArena);
+    }
+    
+    PutRestingIslandsToSleep(Map, Pairs, TimeStep, ControllingIndex, TArena);
+}
+
+//Everything PhysicsUpdate() changes, so the same steps can be run more than once
+struct physics_snapshot
+{
+    v2* P;
+    v2* dP;
+    bool* Awake;
+    f32* RestingTime;
+    u32* SleepIsland;
+    u32* NextInIsland;
+    rect* LastBounds;
+    u32* SortedBodies;
+    contact_cache ContactCache;
+    physics_stats Stats;
+};
+
+static physics_snapshot
+SavePhysicsSnapshot(map_desc* Map, memory_arena* Arena)
+{
+    physics_world* World = &Map->Physics;
+    u32 BodyCount = World->BodyCount;
+    
+    physics_snapshot Result = {};
+    Result.P = AllocArray(Arena, v2, BodyCount);
+    Result.dP = AllocArray(Arena, v2, BodyCount);
+    Result.Awake = AllocArray(Arena, bool, BodyCount);
+    Result.RestingTime = AllocArray(Arena, f32, BodyCount);
+    Result.SleepIsland = AllocArray(Arena, u32, BodyCount);
+    Result.NextInIsland = AllocArray(Arena, u32, BodyCount);
+    Result.LastBounds = AllocArray(Arena, rect, BodyCount);
+    Result.SortedBodies = AllocArray(Arena, u32, Map->Broadphase.SortedBodies.Count);
+    Result.ContactCache = World->ContactCache;
+    Result.ContactCache.Entries = AllocArray(Arena, cached_contact, World->ContactCache.Capacity);
+    Result.Stats = Map->Broadphase.Stats;
+    
+    memcpy(Result.P, World->P, BodyCount * sizeof(v2));
+    memcpy(Result.dP, World->dP, BodyCount * sizeof(v2));
+    memcpy(Result.Awake, World->Awake, BodyCount * sizeof(bool));
+    memcpy(Result.RestingTime, World->RestingTime, BodyCount * sizeof(f32));
+    memcpy(Result.SleepIsland, World->SleepIsland, BodyCount * sizeof(u32));
+    memcpy(Result.NextInIsland, World->NextInIsland, BodyCount * sizeof(u32));
+    memcpy(Result.LastBounds, World->LastBounds, BodyCount * sizeof(rect));
+    memcpy(Result.SortedBodies, Map->Broadphase.SortedBodies.Memory, Map->Broadphase.SortedBodies.Count * sizeof(u32));
+    memcpy(Result.ContactCache.Entries, World->ContactCache.Entries, World->ContactCache.Capacity * sizeof(cached_contact));
+    
+    return Result;
+}
+
+static void
+RestorePhysicsSnapshot(map_desc* Map, physics_snapshot* Snapshot)
+{
+    physics_world* World = &Map->Physics;
+    u32 BodyCount = World->BodyCount;
+    
+    memcpy(World->P, Snapshot->P, BodyCount * sizeof(v2));
+    memcpy(World->dP, Snapshot->dP, BodyCount * sizeof(v2));
+    memcpy(World->Awake, Snapshot->Awake, BodyCount * sizeof(bool));
+    memcpy(World->RestingTime, Snapshot->RestingTime, BodyCount * sizeof(f32));
+    memcpy(World->SleepIsland, Snapshot->SleepIsland, BodyCount * sizeof(u32));
+    memcpy(World->NextInIsland, Snapshot->NextInIsland, BodyCount * sizeof(u32));
+    World->SleepingChanged = true;
+    memcpy(World->LastBounds, Snapshot->LastBounds, BodyCount * sizeof(rect));
+    memcpy(Map->Broadphase.SortedBodies.Memory, Snapshot->SortedBodies, Map->Broadphase.SortedBodies.Count * sizeof(u32));
+    
+    cached_contact* Entries = World->ContactCache.Entries;
+    memcpy(Entries, Snapshot->ContactCache.Entries, World->ContactCache.Capacity * sizeof(cached_contact));
+    World->ContactCache = Snapshot->ContactCache;
+    World->ContactCache.Entries = Entries;
+    
+    Map->Broadphase.Stats = Snapshot->Stats;
+}
+
+struct solver_benchmark
+{
+    u32 Steps;
+    u32 Contacts;
+    u32 WarmStartedContacts;
+    u32 Iterations;
+    f32 DeepestPenetration;
+};
+
+//Runs the map forward from its current state with nothing asleep, then puts it back how it was.
+//Both runs start from an empty contact cache so warm starting has to earn its impulses.
+static solver_benchmark
+BenchmarkSolver(map_desc* Map, bool WarmStarting, u32 VelocityIterations, u32 Steps, f32 TimeStep, memory_arena* TArena)
+{
+    physics_world* World = &Map->Physics;
+    
+    temporary_memory BenchmarkMemory = BeginTemporaryMemory(TArena);
+    physics_snapshot Snapshot = SavePhysicsSnapshot(Map, TArena);
+    
+    bool WasWarmStarting = World->WarmStarting;
+    u32 WasVelocityIterations = World->VelocityIterations;
+    bool WasSleepingEnabled = World->SleepingEnabled;
+    
+    World->WarmStarting = WarmStarting;
+    World->VelocityIterations = VelocityIterations;
+    World->SleepingEnabled = false;
+    World->ContactCache.Stamp++;
+    
+    solver_benchmark Result = {};
+    for (u32 Step = 0; Step < Steps; Step++)
+    {
+        temporary_memory StepMemory = BeginTemporaryMemory(TArena);
+        PhysicsUpdate(Map, TimeStep, V2(0.0f, 0.0f), Map->Player.RigidBodyIndex, TArena);
+        EndTemporaryMemory(StepMemory);
+        
+        physics_stats Stats = Map->Broadphase.Stats;
+        Result.Steps++;
+        Result.Contacts += Stats.ContactCount;
+        Result.WarmStartedContacts += Stats.WarmStartedContacts;
+        Result.Iterations += Stats.SolverIterations;
+        Result.DeepestPenetration = Max(Result.DeepestPenetration, Stats.DeepestPenetration);
+    }
+    
+    World->WarmStarting = WasWarmStarting;
+    World->VelocityIterations = WasVelocityIterations;
+    World->SleepingEnabled = WasSleepingEnabled;
+    
+    RestorePhysicsSnapshot(Map, &Snapshot);
+    EndTemporaryMemory(BenchmarkMemory);
+    
+    return Result;
 }
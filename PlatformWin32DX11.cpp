@@ -53,6 +53,54 @@ struct d3d11_shader
     ID3D11InputLayout* InputLayout;
 };
 
+struct quad_vertex
+{
+    v2 Position;
+    v4 Color;
+};
+
+//A rectangle or a line, instanced.hlsl turns the unit quad into it. Circles use circle.hlsl instead.
+struct shape_instance
+{
+    v2 A; //Position of a rectangle, start of a line, centre of a circle
+    v2 B; //Size of a rectangle, end of a line, radius of a circle in X
+    f32 Thickness; //Zero for rectangles
+    u32 Color;
+};
+
+//A run of vertices in the vertex buffer that goes out in one Draw, or a run of instances for one DrawInstanced
+struct d3d11_draw
+{
+    d3d11_shader* Shader;
+    ID3D11ShaderResourceView* Texture;
+    ID3D11SamplerState* Sampler;
+    u32 Stride;
+    bool Instanced;
+    
+    u32 First;
+    u32 Count;
+};
+
+//Every shape of a frame is appended to one dynamic vertex buffer, as triangles or as one instance of the unit
+//quad. Consecutive shapes with the same shader and texture share a draw.
+struct d3d11_renderer
+{
+    d3d11_device D3D11;
+    
+    ID3D11Buffer* VertexBuffer;
+    ID3D11Buffer* UnitQuad; //Per vertex data of every instanced draw
+    u32 VertexBufferSize;
+    u32 VertexBufferUsed; //Bytes, carried over between frames
+    u8* MappedVertices; //Null when the buffer isn't mapped
+    
+    static_array<d3d11_draw> Draws; //Waiting for the buffer to be unmapped
+    
+    d3d11_shader* BoundShader;
+    ID3D11ShaderResourceView* BoundTexture;
+    u32 BoundStride;
+    bool BoundInstanced;
+};
+
 
 //Platform Functions
 void Win32DebugOut(string String);
@@ -60,23 +108,48 @@ void Win32Sleep(int Milliseconds);
 span<u8> Win32LoadFile(memory_arena* Arena, char* Path);
 void Win32SaveFile(char* Path, span<u8> Data);
 f32 Win32TextWidth(string String, f32 FontSize);
+void Win32AddWork(work_queue* Queue, work_queue_callback* Callback, void* Data);
+void Win32CompleteAllWork(work_queue* Queue);
 
-#define PlatformDebugOut    Win32DebugOut
-#define PlatformSleep       Win32Sleep
-#define PlatformLoadFile    Win32LoadFile
-#define PlatformSaveFile    Win32SaveFile
-#define PlatformTextWidth   Win32TextWidth
+#define PlatformDebugOut        Win32DebugOut
+#define PlatformSleep           Win32Sleep
+#define PlatformLoadFile        Win32LoadFile
+#define PlatformSaveFile        Win32SaveFile
+#define PlatformTextWidth       Win32TextWidth
+#define PlatformAddWork         Win32AddWork
+#define PlatformCompleteAllWork Win32CompleteAllWork
+
+struct work_queue_entry
+{
+    work_queue_callback* Callback;
+    void* Data;
+};
+
+struct work_queue
+{
+    u32 volatile CompletionGoal;
+    u32 volatile CompletionCount;
+    
+    u32 volatile NextEntryToWrite;
+    u32 volatile NextEntryToRead;
+    HANDLE Semaphore;
+    
+    work_queue_entry Entries[256];
+};
+
+work_queue* GlobalWorkQueue;
 
 void KeyboardAndMouseInputState(input_state* InputState, HWND Window);
 memory_arena Win32CreateMemoryArena(u64 Size, memory_arena_type Type);
+void Win32CreateWorkQueue(work_queue* Queue, u32 ThreadCount);
 font_texture CreateFontTexture(allocator Allocator, d3d11_device D3D11, char* Path);
-void DrawText(allocator Allocator, d3d11_device D3D11, font_texture Font, string Text, v2 Position, v4 Color);
+void DrawText(d3d11_renderer* Renderer, d3d11_shader* TextShader, font_texture Font, string Text, v2 Position, v4 Color);
 
 #include "Puzzle.cpp"
 
 static bool GlobalWindowDidResize;
 
-void DirectX11Render(render_group* Group, d3d11_device D3D11, allocator Allocator, d3d11_shader QuadShader, d3d11_shader TextShader, d3d11_shader BackgroundShader, font_texture Font);
+void DirectX11Render(render_group* Group, d3d11_renderer* Renderer, allocator Allocator, d3d11_shader* InstanceShader, d3d11_shader* CircleShader, d3d11_shader* TextShader, d3d11_shader* BackgroundShader, font_texture Font);
 
 d3d11_device CreateD3D11Device()
 {
@@ -244,38 +317,192 @@ d3d11_shader CreateShader(wchar_t* Path, ID3D11Device* Device, D3D11_INPUT_ELEME
     return Result;
 }
 
-void DrawQuad(d3d11_device D3D11, v2 A, v2 B, v2 C, v2 D, v4 Color)
+d3d11_renderer CreateRenderer(d3d11_device D3D11, u32 VertexBufferSize)
 {
-    //Create Vertex Buffer
-    
-    f32 VertexData[] = {
-        A.X, A.Y, Color.R, Color.G, Color.B, Color.A,
-        B.X, B.Y, Color.R, Color.G, Color.B, Color.A,
-        C.X, C.Y, Color.R, Color.G, Color.B, Color.A,
-        D.X, D.Y, Color.R, Color.G, Color.B, Color.A
-    };
-    
-    u32 Stride = 6 * sizeof(f32);
-    u32 VertexCount = sizeof(VertexData) / Stride;
-    u32 Offset = 0;
+    d3d11_renderer Result = {};
+    Result.D3D11 = D3D11;
     
     D3D11_BUFFER_DESC VertexBufferDesc = {};
-    VertexBufferDesc.ByteWidth = sizeof(VertexData);
-    VertexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+    VertexBufferDesc.ByteWidth = VertexBufferSize;
+    VertexBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
     VertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    VertexBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
     
-    D3D11_SUBRESOURCE_DATA VertexSubresourceData = { VertexData };
+    HRESULT HResult = D3D11.Device->CreateBuffer(&VertexBufferDesc, 0, &Result.VertexBuffer);
+    Assert(SUCCEEDED(HResult));
     
-    ID3D11Buffer* VertexBuffer;
-    HRESULT HResult = D3D11.Device->CreateBuffer(&VertexBufferDesc, &VertexSubresourceData, &VertexBuffer);
+    //The same two triangles as PushQuad, with A at (0, 1) and D at (1, 0)
+    v2 UnitQuad[6] = {V2(0.0f, 1.0f), V2(1.0f, 1.0f), V2(0.0f, 0.0f), V2(0.0f, 0.0f), V2(1.0f, 1.0f), V2(1.0f, 0.0f)};
+    
+    D3D11_BUFFER_DESC UnitQuadDesc = {};
+    UnitQuadDesc.ByteWidth = sizeof(UnitQuad);
+    UnitQuadDesc.Usage = D3D11_USAGE_IMMUTABLE;
+    UnitQuadDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    
+    D3D11_SUBRESOURCE_DATA UnitQuadData = {};
+    UnitQuadData.pSysMem = UnitQuad;
+    
+    HResult = D3D11.Device->CreateBuffer(&UnitQuadDesc, &UnitQuadData, &Result.UnitQuad);
     Assert(SUCCEEDED(HResult));
     
-    //Draw
-    D3D11.DeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
-    D3D11.DeviceContext->IASetVertexBuffers(0, 1, &VertexBuffer, &Stride, &Offset);
-    D3D11.DeviceContext->Draw(VertexCount, 0);
+    Result.VertexBufferSize = VertexBufferSize;
+    Result.VertexBufferUsed = VertexBufferSize; //The first map discards
+    
+    return Result;
+}
+
+//Issues the draws that were recorded since the last submit. The buffer has to be unmapped before the GPU can read it.
+void SubmitDraws(d3d11_renderer* Renderer)
+{
+    ID3D11DeviceContext1* DeviceContext = Renderer->D3D11.DeviceContext;
+    
+    if (Renderer->MappedVertices)
+    {
+        DeviceContext->Unmap(Renderer->VertexBuffer, 0);
+        Renderer->MappedVertices = 0;
+    }
+    
+    for (d3d11_draw Draw : Renderer->Draws)
+    {
+        if (Draw.Shader != Renderer->BoundShader)
+        {
+            DeviceContext->IASetInputLayout(Draw.Shader->InputLayout);
+            DeviceContext->VSSetShader(Draw.Shader->VertexShader, 0, 0);
+            DeviceContext->PSSetShader(Draw.Shader->PixelShader, 0, 0);
+            Renderer->BoundShader = Draw.Shader;
+        }
+        
+        if (Draw.Texture && Draw.Texture != Renderer->BoundTexture)
+        {
+            DeviceContext->PSSetShaderResources(0, 1, &Draw.Texture);
+            DeviceContext->PSSetSamplers(0, 1, &Draw.Sampler);
+            Renderer->BoundTexture = Draw.Texture;
+        }
+        
+        if (Draw.Stride != Renderer->BoundStride || Draw.Instanced != Renderer->BoundInstanced)
+        {
+            if (Draw.Instanced)
+            {
+                ID3D11Buffer* Buffers[2] = {Renderer->UnitQuad, Renderer->VertexBuffer};
+                u32 Strides[2] = {sizeof(v2), Draw.Stride};
+                u32 Offsets[2] = {0, 0};
+                DeviceContext->IASetVertexBuffers(0, 2, Buffers, Strides, Offsets);
+            }
+            else
+            {
+                u32 Offset = 0;
+                DeviceContext->IASetVertexBuffers(0, 1, &Renderer->VertexBuffer, &Draw.Stride, &Offset);
+            }
+            Renderer->BoundStride = Draw.Stride;
+            Renderer->BoundInstanced = Draw.Instanced;
+        }
+        
+        if (Draw.Instanced)
+        {
+            DeviceContext->DrawInstanced(6, Draw.Count, 0, Draw.First);
+        }
+        else
+        {
+            DeviceContext->Draw(Draw.Count, Draw.First);
+        }
+    }
+    
+    Renderer->Draws.Count = 0;
+}
+
+//Appending after the vertices earlier draws read doesn't stall. Once the buffer is full it's discarded instead,
+//the driver hands out fresh memory while the GPU finishes with the old.
+void MapVertexBuffer(d3d11_renderer* Renderer, D3D11_MAP MapType)
+{
+    Assert(!Renderer->MappedVertices);
+    
+    D3D11_MAPPED_SUBRESOURCE MappedResource;
+    HRESULT HResult = Renderer->D3D11.DeviceContext->Map(Renderer->VertexBuffer, 0, MapType, 0, &MappedResource);
+    Assert(SUCCEEDED(HResult));
+    
+    Renderer->MappedVertices = (u8*)MappedResource.pData;
+    if (MapType == D3D11_MAP_WRITE_DISCARD)
+    {
+        Renderer->VertexBufferUsed = 0;
+    }
+}
+
+//Returns room for Count elements of Stride bytes, which are vertices or instances for the given shader and texture
+static u8*
+PushDrawData(d3d11_renderer* Renderer, d3d11_shader* Shader, ID3D11ShaderResourceView* Texture, ID3D11SamplerState* Sampler, 
+             u32 Stride, bool Instanced, u32 Count)
+{
+    u32 Size = Count * Stride;
+    Assert(Size <= Renderer->VertexBufferSize);
+    
+    d3d11_draw* LastDraw = (Renderer->Draws.Count > 0) ? &Renderer->Draws[Renderer->Draws.Count - 1] : 0;
+    bool ExtendsLastDraw = (LastDraw && Renderer->MappedVertices &&
+                            LastDraw->Shader == Shader && LastDraw->Texture == Texture && LastDraw->Stride == Stride &&
+                            LastDraw->Instanced == Instanced &&
+                            (LastDraw->First + LastDraw->Count) * Stride == Renderer->VertexBufferUsed);
+    
+    //Draws index whole elements, so a new draw starts on a multiple of its stride
+    u32 Start = (Renderer->VertexBufferUsed + Stride - 1) / Stride * Stride;
+    
+    if (Start + Size > Renderer->VertexBufferSize)
+    {
+        SubmitDraws(Renderer);
+        MapVertexBuffer(Renderer, D3D11_MAP_WRITE_DISCARD);
+        Start = 0;
+        ExtendsLastDraw = false;
+    }
+    else if (!ExtendsLastDraw && Renderer->Draws.Count == Renderer->Draws.Capacity)
+    {
+        SubmitDraws(Renderer);
+    }
+    
+    if (!Renderer->MappedVertices)
+    {
+        MapVertexBuffer(Renderer, D3D11_MAP_WRITE_NO_OVERWRITE);
+    }
+    
+    if (!ExtendsLastDraw)
+    {
+        d3d11_draw Draw = {Shader, Texture, Sampler, Stride, Instanced, Start / Stride, 0};
+        Add(&Renderer->Draws, Draw);
+    }
+    Renderer->Draws[Renderer->Draws.Count - 1].Count += Count;
+    
+    u8* Result = Renderer->MappedVertices + Start;
+    Renderer->VertexBufferUsed = Start + Size;
+    
+    return Result;
+}
+
+//Returns room for VertexCount vertices, drawn as a triangle list with the given shader and texture
+u8* PushVertices(d3d11_renderer* Renderer, d3d11_shader* Shader, ID3D11ShaderResourceView* Texture, ID3D11SamplerState* Sampler, 
+                 u32 Stride, u32 VertexCount)
+{
+    return PushDrawData(Renderer, Shader, Texture, Sampler, Stride, false, VertexCount);
+}
+
+//Consecutive shapes with the same shader share one DrawInstanced
+void PushShapeInstance(d3d11_renderer* Renderer, d3d11_shader* InstanceShader, v2 A, v2 B, f32 Thickness, u32 Color)
+{
+    shape_instance* Instance = (shape_instance*)PushDrawData(Renderer, InstanceShader, 0, 0, sizeof(shape_instance), true, 1);
     
-    VertexBuffer->Release();
+    Instance->A = A;
+    Instance->B = B;
+    Instance->Thickness = Thickness;
+    Instance->Color = Color;
+}
+
+//A, B, C, D in triangle strip order
+void PushQuad(d3d11_renderer* Renderer, d3d11_shader* Shader, v2 A, v2 B, v2 C, v2 D, v4 Color)
+{
+    quad_vertex* Vertices = (quad_vertex*)PushVertices(Renderer, Shader, 0, 0, sizeof(quad_vertex), 6);
+    
+    Vertices[0] = {A, Color};
+    Vertices[1] = {B, Color};
+    Vertices[2] = {C, Color};
+    Vertices[3] = {C, Color};
+    Vertices[4] = {B, Color};
+    Vertices[5] = {D, Color};
 }
 
 int WINAPI wWinMain(HINSTANCE Instance, HINSTANCE, LPWSTR CommandLine, int ShowCode)
@@ -313,16 +540,28 @@ int WINAPI wWinMain(HINSTANCE Instance, HINSTANCE, LPWSTR CommandLine, int ShowC
     IDXGISwapChain1* SwapChain = CreateD3D11SwapChain(D3D11.Device, Window);
     ID3D11RenderTargetView* FrameBufferView = CreateRenderTarget(D3D11.Device, SwapChain);
     
+    d3d11_renderer Renderer = CreateRenderer(D3D11, Megabytes(4));
+    
     D3D11_INPUT_ELEMENT_DESC InputElementDesc[] = 
     {
         {"POS", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
         {"COL", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0}
     };
     
-    d3d11_shader Shader = CreateShader(L"assets/shaders.hlsl", D3D11.Device, InputElementDesc, ArrayCount(InputElementDesc));
-    
     d3d11_shader BackgroundShader = CreateShader(L"assets/background.hlsl", D3D11.Device, InputElementDesc, ArrayCount(InputElementDesc));
     
+    //Colors are 0xAARRGGBB, so in memory the bytes are B, G, R, A and the shader swizzles them back
+    D3D11_INPUT_ELEMENT_DESC InstanceInputElementDesc[] = 
+    {
+        {"CORNER", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"A", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+        {"B", 0, DXGI_FORMAT_R32G32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+        {"THICKNESS", 0, DXGI_FORMAT_R32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+        {"COL", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1}
+    };
+    d3d11_shader InstanceShader = CreateShader(L"assets/instanced.hlsl", D3D11.Device, InstanceInputElementDesc, ArrayCount(InstanceInputElementDesc));
+    d3d11_shader CircleShader = CreateShader(L"assets/circle.hlsl", D3D11.Device, InstanceInputElementDesc, ArrayCount(InstanceInputElementDesc));
+    
     D3D11_INPUT_ELEMENT_DESC FontShaderInputElementDesc[] = 
     {
         {"POS", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
@@ -361,7 +600,6 @@ int WINAPI wWinMain(HINSTANCE Instance, HINSTANCE, LPWSTR CommandLine, int ShowC
     QueryPerformanceFrequency(&CounterFrequency); //Counts per second
     
     int TargetFrameRate = 60;
-    float SecondsPerFrame = 1.0f / (float)TargetFrameRate;
     int CountsPerFrame = (int)(CounterFrequency.QuadPart / TargetFrameRate);
     
     game_input PreviousInput = {};
@@ -369,16 +607,31 @@ int WINAPI wWinMain(HINSTANCE Instance, HINSTANCE, LPWSTR CommandLine, int ShowC
     render_group RenderGroup;
     RenderGroup.ShapeCount = 0;
     
+    SYSTEM_INFO SystemInfo;
+    GetSystemInfo(&SystemInfo);
+    
+    //The main thread works on the queue too while it waits
+    work_queue WorkQueue = {};
+    Win32CreateWorkQueue(&WorkQueue, Max(1, (int)SystemInfo.dwNumberOfProcessors - 1));
+    GlobalWorkQueue = &WorkQueue;
+    
     game_state* GameState = GameInitialise(Allocator);
     
     font_texture FontTexture = CreateFontTexture(Allocator, D3D11, "assets/LiberationMono-Regular.ttf");
     DefaultFont = &FontTexture;
     
+    LARGE_INTEGER LastStartCount;
+    QueryPerformanceCounter(&LastStartCount);
+    
     while (true)
     {
         LARGE_INTEGER StartCount;
         QueryPerformanceCounter(&StartCount);
         
+        //The game runs its own fixed ticks, it just needs to know how much time really passed
+        f32 FrameTime = (f32)(StartCount.QuadPart - LastStartCount.QuadPart) / CounterFrequency.QuadPart;
+        LastStartCount = StartCount;
+        
         MSG Message;
         while (PeekMessage(&Message, 0, 0, 0, PM_REMOVE))
         {
@@ -439,7 +692,7 @@ int WINAPI wWinMain(HINSTANCE Instance, HINSTANCE, LPWSTR CommandLine, int ShowC
         PreviousInput = Input;
         
         ResetArena(&TransientArena);
-        GameUpdateAndRender(&RenderGroup, GameState, SecondsPerFrame, &Input, Allocator);
+        GameUpdateAndRender(&RenderGroup, GameState, FrameTime, &Input, Allocator);
         
         //..........................
         FLOAT Color[4] = {0.1f, 0.2f, 0.3f, 1.0f};
@@ -452,11 +705,7 @@ int WINAPI wWinMain(HINSTANCE Instance, HINSTANCE, LPWSTR CommandLine, int ShowC
         
         D3D11.DeviceContext->OMSetRenderTargets(1, &FrameBufferView, 0);
         
-        D3D11.DeviceContext->IASetInputLayout(Shader.InputLayout);
-        D3D11.DeviceContext->VSSetShader(Shader.VertexShader, 0, 0);
-        D3D11.DeviceContext->PSSetShader(Shader.PixelShader, 0, 0);
-        
-        DirectX11Render(&RenderGroup, D3D11, Allocator, Shader, FontShader, BackgroundShader, FontTexture);
+        DirectX11Render(&RenderGroup, &Renderer, Allocator, &InstanceShader, &CircleShader, &FontShader, &BackgroundShader, FontTexture);
         
         SwapChain->Present(1, 0);
         //---------------------------
@@ -481,8 +730,18 @@ int WINAPI wWinMain(HINSTANCE Instance, HINSTANCE, LPWSTR CommandLine, int ShowC
     }
 }
 
-void DirectX11Render(render_group* Group, d3d11_device D3D11, allocator Allocator, d3d11_shader QuadShader, d3d11_shader TextShader, d3d11_shader BackgroundShader, font_texture Font)
+void DirectX11Render(render_group* Group, d3d11_renderer* Renderer, allocator Allocator, d3d11_shader* InstanceShader, d3d11_shader* CircleShader, d3d11_shader* TextShader, d3d11_shader* BackgroundShader, font_texture Font)
 {
+    u32 const MaxDrawCount = 1024;
+    Renderer->Draws = AllocStaticArray(Allocator.Transient, d3d11_draw, MaxDrawCount);
+    
+    //Nothing is assumed to still be bound from last frame
+    Renderer->BoundShader = 0;
+    Renderer->BoundTexture = 0;
+    Renderer->BoundStride = 0;
+    Renderer->BoundInstanced = false;
+    Renderer->D3D11.DeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    
     for (u32 Index = 0; Index < Group->ShapeCount; Index++)
     {
         render_shape Shape = Group->Shapes[Index];
@@ -498,28 +757,23 @@ void DirectX11Render(render_group* Group, d3d11_device D3D11, allocator Allocato
         {
             case Render_Rectangle:
             {
-                v2 Origin = Shape.Rectangle.Position;
-                v2 XAxis = V2(Shape.Rectangle.Size.X, 0.0f);
-                v2 YAxis = V2(0.0f, Shape.Rectangle.Size.Y);
-                
-                D3D11.DeviceContext->IASetInputLayout(QuadShader.InputLayout);
-                D3D11.DeviceContext->VSSetShader(QuadShader.VertexShader, 0, 0);
-                D3D11.DeviceContext->PSSetShader(QuadShader.PixelShader, 0, 0);
-                DrawQuad(D3D11, Origin + YAxis, Origin + YAxis + XAxis, Origin, Origin + XAxis, Color);
+                PushShapeInstance(Renderer, InstanceShader, Shape.Rectangle.Position, Shape.Rectangle.Size, 0.0f, Shape.Color);
             } break;
             case Render_Circle:
             {
+                if (Shape.Circle.Radius > 0.0f)
+                {
+                    v2 Radius = V2(Shape.Circle.Radius, 0.0f);
+                    PushShapeInstance(Renderer, CircleShader, Shape.Circle.Position, Radius, 0.0f, Shape.Color);
+                }
             } break;
             case Render_Line:
             {
-                v2 XAxis = Shape.Line.End - Shape.Line.Start;
-                v2 YAxis = UnitV(Perp(XAxis)) * Shape.Line.Thickness;
-                v2 Origin = Shape.Line.Start - 0.5f * YAxis;
-                
-                D3D11.DeviceContext->IASetInputLayout(QuadShader.InputLayout);
-                D3D11.DeviceContext->VSSetShader(QuadShader.VertexShader, 0, 0);
-                D3D11.DeviceContext->PSSetShader(QuadShader.PixelShader, 0, 0);
-                DrawQuad(D3D11, Origin + YAxis, Origin + YAxis + XAxis, Origin, Origin + XAxis, Color);
+                //A line without thickness covers nothing, and zero thickness means a rectangle to the shader
+                if (Shape.Line.Thickness > 0.0f)
+                {
+                    PushShapeInstance(Renderer, InstanceShader, Shape.Line.Start, Shape.Line.End, Shape.Line.Thickness, Shape.Color);
+                }
             } break;
             case Render_Text:
             {
@@ -528,10 +782,7 @@ void DirectX11Render(render_group* Group, d3d11_device D3D11, allocator Allocato
                     break;
                 }
                 
-                D3D11.DeviceContext->IASetInputLayout(TextShader.InputLayout);
-                D3D11.DeviceContext->VSSetShader(TextShader.VertexShader, 0, 0);
-                D3D11.DeviceContext->PSSetShader(TextShader.PixelShader, 0, 0);
-                DrawText(Allocator, D3D11, Font, Shape.Text.String, Shape.Text.Position, Color);
+                DrawText(Renderer, TextShader, Font, Shape.Text.String, Shape.Text.Position, Color);
             } break;
             case Render_Background:
             {
@@ -539,15 +790,14 @@ void DirectX11Render(render_group* Group, d3d11_device D3D11, allocator Allocato
                 v2 XAxis = V2(Shape.Rectangle.Size.X, 0.0f);
                 v2 YAxis = V2(0.0f, Shape.Rectangle.Size.Y);
                 
-                D3D11.DeviceContext->IASetInputLayout(BackgroundShader.InputLayout);
-                D3D11.DeviceContext->VSSetShader(BackgroundShader.VertexShader, 0, 0);
-                D3D11.DeviceContext->PSSetShader(BackgroundShader.PixelShader, 0, 0);
-                DrawQuad(D3D11, Origin + YAxis, Origin + YAxis + XAxis, Origin, Origin + XAxis, Color);
+                PushQuad(Renderer, BackgroundShader, Origin + YAxis, Origin + YAxis + XAxis, Origin, Origin + XAxis, Color);
             } break;
             default: Assert(0);
         }
         
     }
+    
+    SubmitDraws(Renderer);
 }
 LRESULT CALLBACK WindowProc(HWND Window, UINT Message, WPARAM WParam, LPARAM LParam)
 {
@@ -654,6 +904,82 @@ void Win32Sleep(int Milliseconds)
     Sleep(Milliseconds);
 }
 
+//Only the main thread adds work
+void Win32AddWork(work_queue* Queue, work_queue_callback* Callback, void* Data)
+{
+    u32 NewNextEntryToWrite = (Queue->NextEntryToWrite + 1) % ArrayCount(Queue->Entries);
+    Assert(NewNextEntryToWrite != Queue->NextEntryToRead);
+    
+    work_queue_entry* Entry = Queue->Entries + Queue->NextEntryToWrite;
+    Entry->Callback = Callback;
+    Entry->Data = Data;
+    Queue->CompletionGoal++;
+    
+    _WriteBarrier();
+    Queue->NextEntryToWrite = NewNextEntryToWrite;
+    ReleaseSemaphore(Queue->Semaphore, 1, 0);
+}
+
+static bool
+Win32DoNextWorkEntry(work_queue* Queue)
+{
+    bool ShouldSleep = false;
+    
+    u32 OriginalNextEntryToRead = Queue->NextEntryToRead;
+    u32 NewNextEntryToRead = (OriginalNextEntryToRead + 1) % ArrayCount(Queue->Entries);
+    if (OriginalNextEntryToRead != Queue->NextEntryToWrite)
+    {
+        u32 Index = InterlockedCompareExchange((LONG volatile*)&Queue->NextEntryToRead, NewNextEntryToRead, OriginalNextEntryToRead);
+        if (Index == OriginalNextEntryToRead)
+        {
+            work_queue_entry Entry = Queue->Entries[Index];
+            Entry.Callback(Entry.Data);
+            InterlockedIncrement((LONG volatile*)&Queue->CompletionCount);
+        }
+    }
+    else
+    {
+        ShouldSleep = true;
+    }
+    
+    return ShouldSleep;
+}
+
+void Win32CompleteAllWork(work_queue* Queue)
+{
+    while (Queue->CompletionGoal != Queue->CompletionCount)
+    {
+        Win32DoNextWorkEntry(Queue);
+    }
+    
+    Queue->CompletionGoal = 0;
+    Queue->CompletionCount = 0;
+}
+
+static DWORD WINAPI
+Win32WorkerThread(LPVOID Parameter)
+{
+    work_queue* Queue = (work_queue*)Parameter;
+    while (true)
+    {
+        if (Win32DoNextWorkEntry(Queue))
+        {
+            WaitForSingleObjectEx(Queue->Semaphore, INFINITE, FALSE);
+        }
+    }
+}
+
+void Win32CreateWorkQueue(work_queue* Queue, u32 ThreadCount)
+{
+    Queue->Semaphore = CreateSemaphoreEx(0, 0, ThreadCount, 0, 0, SEMAPHORE_ALL_ACCESS);
+    
+    for (u32 ThreadIndex = 0; ThreadIndex < ThreadCount; ThreadIndex++)
+    {
+        HANDLE Thread = CreateThread(0, 0, Win32WorkerThread, Queue, 0, 0);
+        CloseHandle(Thread);
+    }
+}
+
 static memory_arena
 Win32CreateMemoryArena(u64 Size, memory_arena_type Type)
 {
@@ -780,18 +1106,17 @@ struct char_vertex
     v4 Color;
 };
 
-void DrawText(allocator Allocator, d3d11_device D3D11, font_texture Font, string Text, v2 Position, v4 Color)
+void DrawText(d3d11_renderer* Renderer, d3d11_shader* TextShader, font_texture Font, string Text, v2 Position, v4 Color)
 {
     f32 FontTexturePixelsToScreen = (6.0f) / Font.RasterisedSize / Font.TextureHeight;
     
     f32 X = Position.X;
     f32 Y = Position.Y;
     
-    u32 Stride = sizeof(char_vertex);
-    u32 Offset = 0;
     u32 VertexCount = 6 * Text.Length;
     
-    char_vertex* VertexData = AllocArray(Allocator.Transient, char_vertex, VertexCount);
+    char_vertex* VertexData = (char_vertex*)PushVertices(Renderer, TextShader, Font.TextureView, Font.SamplerState, 
+                                                         sizeof(char_vertex), VertexCount);
     
     for (u32 I = 0; I < Text.Length; I++)
     {
@@ -828,27 +1153,6 @@ void DrawText(allocator Allocator, d3d11_device D3D11, font_texture Font, string
         
         X += BakedChar.xadvance * FontTexturePixelsToScreen;
     }
-    
-    D3D11_BUFFER_DESC VertexBufferDesc = {};
-    VertexBufferDesc.ByteWidth = VertexCount * sizeof(char_vertex);
-    VertexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
-    VertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-    
-    D3D11_SUBRESOURCE_DATA VertexSubresourceData = { VertexData };
-    
-    ID3D11Buffer* VertexBuffer;
-    HRESULT HResult = D3D11.Device->CreateBuffer(&VertexBufferDesc, &VertexSubresourceData, &VertexBuffer);
-    Assert(SUCCEEDED(HResult));
-    
-    D3D11.DeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    D3D11.DeviceContext->IASetVertexBuffers(0, 1, &VertexBuffer, &Stride, &Offset);
-    
-    D3D11.DeviceContext->PSSetShaderResources(0, 1, &Font.TextureView);
-    D3D11.DeviceContext->PSSetSamplers(0, 1, &Font.SamplerState);
-    
-    D3D11.DeviceContext->Draw(VertexCount, 0);
-    
-    VertexBuffer->Release();
 }
 
 f32 Win32TextWidth(string String, f32 FontSize)
@@ -3,193 +3,13 @@
 
 #include "Graphics.cpp"
 #include "GUI.cpp"
-#include "Editor.cpp"
 #include "Physics.cpp"
+#include "Activation.cpp"
+#include "Lasers.cpp"
+#include "Editor.cpp"
 #include "Console.cpp"
 
-void PhysicsUpdate(span<rigid_body> RigidBodies, f32 DeltaTime, v2 Movement, rigid_body* Controlling);
-
-u32 GetColorOfEntity(map_desc* Map, u32 EntityIndex)
-{
-    u32 Result = 0;
-    
-    entity* Entity = Map->Entities + EntityIndex;
-    if (Entity->RigidBodyIndex)
-    {
-        Result = Map->RigidBodies[Entity->RigidBodyIndex].Color;
-    }
-    else if (Entity->LineIndex)
-    {
-        Result = Map->Lines[Entity->LineIndex].Color;
-    }
-    else if (Entity->LaserIndex)
-    {
-        Result = Map->Lasers[Entity->LaserIndex].Color;
-    }
-    
-    return Result;
-}
-
-struct ray_collision
-{
-    bool DidHit;
-    v2 P;
-    v2 Normal;
-    f32 t;
-};
-
-static ray_collision
-TestRayIntersection(v2 P, v2 Direction, line_segment Wall)
-{
-    f32 Epsilon = 0.00001f;
-    v2 WallDirection = Wall.End - Wall.Start;
-    
-    v2 st = Inverse(M2x2(WallDirection, -1.0f * Direction)) * (P - Wall.Start);
-    f32 s = st.X;
-    f32 t = st.Y;
-    
-    ray_collision Result = {};
-    Result.DidHit = (s >= 0.0f && s <= 1.0f) && (t > 0.0f);
-    if (Result.DidHit)
-    {
-        Result.P = P + t * Direction - Epsilon * UnitV(Direction);
-        Result.Normal = Direction - DotProduct(Direction, UnitV(WallDirection)) * UnitV(WallDirection); //TODO : Make a projection function
-        Result.t = t;
-    }
-    return Result;
-}
-
-struct laser_beam
-{
-    v2 Start;
-    v2 End;
-    u32 Color;
-};
-
-static void
-CalculateReflections(laser_beam* Result, u32 MaxIter, map_desc* Map, laser* Laser)
-{
-    v2 P = Laser->Position;
-    f32 AngleRadians = Laser->Angle * 2 * 3.14159f;
-    v2 Direction = { cosf(AngleRadians), sinf(AngleRadians) };
-    
-    bool Done = false;
-    
-    u32 Color = Laser->Color;
-    
-    u32 Iter = 0;
-    for (; Iter < MaxIter; Iter++)
-    {
-        f32 tMin = 100.0f;
-        
-        ray_collision NearestCollision = {};
-        u32 NearestCollisionEntityIndex = 0;
-        
-        bool WillReflect = false;
-        
-        bool WillContinueThrough = false;
-        u32 CollidedWithColor = 0;
-        
-        for (line Line : Map->Lines)
-        {
-            line_segment LineSegment = {Line.Start, Line.Start + Line.Offset};
-            ray_collision Collision = TestRayIntersection(P, Direction, LineSegment);
-            
-            if (Collision.DidHit && Collision.t < tMin)
-            {
-                NearestCollision = Collision;
-                tMin = Collision.t;
-                WillReflect = Line.Reflective;
-                NearestCollisionEntityIndex = Line.EntityIndex;
-            }
-        }
-        
-        for (rigid_body& RigidBody : Map->RigidBodies)
-        {
-            v2 MinCorner = RigidBody.P - 0.5f * RigidBody.Size;
-            v2 MaxCorner = RigidBody.P + 0.5f * RigidBody.Size;
-            
-            line_segment Edges[4] = {
-                {MinCorner, V2(MaxCorner.X, MinCorner.Y)},
-                {MinCorner, V2(MinCorner.X, MaxCorner.Y)},
-                {MaxCorner, V2(MinCorner.X, MaxCorner.Y)},
-                {MaxCorner, V2(MaxCorner.X, MinCorner.Y)},
-            }; 
-            
-            for (line_segment Edge : Edges)
-            {
-                ray_collision Collision = TestRayIntersection(P, Direction, Edge);
-                
-                if (Collision.DidHit && Collision.t < tMin)
-                {
-                    NearestCollision = Collision;
-                    tMin = Collision.t;
-                    NearestCollisionEntityIndex = RigidBody.EntityIndex;
-                    
-                    WillReflect = false;
-                    WillContinueThrough = (RigidBody.Translucent);
-                    if (WillContinueThrough)
-                    {
-                        CollidedWithColor = RigidBody.Color;
-                    }
-                }
-            }
-        }
-        
-        if (NearestCollision.DidHit)
-        {
-            laser_beam* LaserBeam = &Result[Iter];
-            LaserBeam->Start = P;
-            LaserBeam->End = NearestCollision.P;
-            LaserBeam->Color = Color;
-            
-            if (NearestCollisionEntityIndex)
-            {
-                if (Color == GetColorOfEntity(Map, NearestCollisionEntityIndex))
-                {
-                    Map->Entities[NearestCollisionEntityIndex].IsActivated = true;
-                }
-            }
-            
-            if (WillReflect)
-            {
-                P = NearestCollision.P;
-                Direction = Direction - 2 * DotProduct(Direction, UnitV(NearestCollision.Normal)) * UnitV(NearestCollision.Normal);
-            }
-            else if (WillContinueThrough)
-            {
-                P = NearestCollision.P + 0.0001f * Direction;
-                
-                u8* GlassColor = (u8*)&CollidedWithColor;
-                u8* OldColor = (u8*)&Color;
-                for (int I = 0; I < 4; I++)
-                {
-                    if (OldColor[I] > GlassColor[I])
-                    {
-                        OldColor[I] = GlassColor[I];
-                    }
-                }
-            }
-            else
-            {
-                Done = true;
-                break;
-            }
-        }
-        else
-        {
-            break;
-        }
-    }
-    
-    if (!Done && Iter < MaxIter)
-    {
-        laser_beam* LaserBeam = &Result[Iter];
-        LaserBeam->Start = P;
-        LaserBeam->End = P + 10.0f * UnitV(Direction);
-        LaserBeam->Color = Color;
-    }
-}
+void PhysicsUpdate(map_desc* Map, f32 DeltaTime, v2 Movement, u32 ControllingIndex, memory_arena* TArena);
 
 static void 
 LoadMaps(allocator Allocator, game_state* Game)
@@ -222,14 +42,18 @@ LoadMaps(allocator Allocator, game_state* Game)
     Game->Maps = Maps;
 }
 
-static game_state* 
+[[maybe_unused]] static game_state* 
 GameInitialise(allocator Allocator)
 {
     game_state* GameState = AllocStruct(Allocator.Permanent, game_state);
     
+    GlobalMaxSimdLevel = DetectSimdLevel();
+    GlobalSimdLevel = GlobalMaxSimdLevel;
+    
     LoadMaps(Allocator, GameState);
     
-    GameState->MapArena = CreateSubArena(Allocator.Permanent, Kilobytes(16));
+    GameState->MapArena = CreateSubArena(Allocator.Permanent, Megabytes(1));
+    GameState->TicksPerSecond = 120.0f; //Swept collision and warm starting keep stacks and thin walls solid at this rate
     
     GameState->Map = GameState->Maps[0];
     Assert(GameState->Map);
@@ -237,51 +61,38 @@ GameInitialise(allocator Allocator)
     return GameState;
 }
 
+//Everything DrawMap() interpolates, as it was before the tick
 static void
-SimulateGame(game_state* GameState, game_input* Input, f32 DeltaTime, memory_arena* Arena)
+SavePreviousDrawState(map_desc* Map)
 {
-    v2 Movement = Input->Movement;
+    SavePreviousState(&Map->Physics);
     
-    for (entity& Entity : GameState->Map->Entities)
+    for (u32 LineIndex = 0; LineIndex < Map->Lines.Count; LineIndex++)
     {
-        Entity.WasActivated = Entity.IsActivated;
-        Entity.IsActivated = false;
+        Map->PrevLineStarts[LineIndex] = Map->Lines[LineIndex].Start;
     }
-    
-    for (rigid_body& RigidBody : GameState->Map->RigidBodies)
+    for (u32 LaserIndex = 0; LaserIndex < Map->Lasers.Count; LaserIndex++)
     {
-        if (RigidBody.ActivatedByIndex)
-        {
-            bool Activated = GameState->Map->Entities[RigidBody.ActivatedByIndex].WasActivated;
-            
-            v2 TargetP, TargetSize;
-            if (Activated)
-            {
-                TargetP = RigidBody.ActivatedP;
-                TargetSize = RigidBody.ActivatedSize;
-            }
-            else
-            {
-                TargetP = RigidBody.UnactivatedP;
-                TargetSize = RigidBody.UnactivatedSize;
-            }
-            
-            f32 Speed = 3.0f;
-            RigidBody.P = LinearInterpolate(RigidBody.P, TargetP, DeltaTime * Speed);
-            RigidBody.Size = LinearInterpolate(RigidBody.Size, TargetSize, DeltaTime * Speed);
-        }
+        Map->PrevLaserPositions[LaserIndex] = Map->Lasers[LaserIndex].Position;
+        Map->PrevBeamCounts[LaserIndex] = Map->LaserTraces[LaserIndex].BeamCount;
     }
     
+    memcpy(Map->PrevLaserBeams.Memory, Map->LaserBeams.Memory, Map->LaserBeams.Count * sizeof(laser_beam));
+    Map->PrevLaserBeams.Count = Map->LaserBeams.Count;
+}
+
+static void
+SimulateTick(game_state* GameState, v2 Movement, f32 DeltaTime, allocator Allocator)
+{
+    physics_world* World = &GameState->Map->Physics;
+    SavePreviousDrawState(GameState->Map);
+    
+    MoveDrivenBodies(GameState->Map, DeltaTime);
+    
     if (GameState->Map->RigidBodies.Count > 0)
     {
-        rigid_body* Controlling = GameState->Map->RigidBodies + GameState->Map->Player.RigidBodyIndex;
-        
-        if (Input->ButtonDown & Button_Jump)
-        {
-            Controlling->dP.Y = 1.5f;
-        }
-        
-        PhysicsUpdate(ToSpan(GameState->Map->RigidBodies), DeltaTime, Movement, Controlling);
+        u32 ControllingIndex = GameState->Map->Player.RigidBodyIndex;
+        PhysicsUpdate(GameState->Map, DeltaTime, Movement, ControllingIndex, Allocator.Transient);
     }
     
     for (attachment Attachment : GameState->Map->Attachments)
@@ -293,13 +104,11 @@ SimulateGame(game_state* GameState, game_input* Input, f32 DeltaTime, memory_are
         entity* AttachedTo = GameState->Map->Entities + Attachment.AttachedToEntityIndex;
         
         Assert(AttachedTo->RigidBodyIndex);
-        rigid_body* AttachedToRigidBody = GameState->Map->RigidBodies + AttachedTo->RigidBodyIndex;
-        v2 P = AttachedToRigidBody->P + Attachment.Offset;
+        v2 P = BodyP(World, AttachedTo->RigidBodyIndex) + Attachment.Offset;
         
         if (Entity->RigidBodyIndex)
         {
-            rigid_body* RigidBody = GameState->Map->RigidBodies + Entity->RigidBodyIndex;
-            RigidBody->P = P;
+            BodyP(World, Entity->RigidBodyIndex) = P;
         }
         if (Entity->LineIndex)
         {
@@ -313,6 +122,32 @@ SimulateGame(game_state* GameState, game_input* Input, f32 DeltaTime, memory_are
         }
     }
     
+    TraceLasers(GameState->Map, Allocator.Transient);
+}
+
+static void
+SimulateGame(game_state* GameState, game_input* Input, f32 DeltaTime, allocator Allocator)
+{
+    physics_world* World = &GameState->Map->Physics;
+    if (GameState->Map->RigidBodies.Count > 0 && (Input->ButtonDown & Button_Jump))
+    {
+        BodydP(World, GameState->Map->Player.RigidBodyIndex).Y = 1.5f;
+    }
+    
+    //After a long stall the time is dropped instead of simulated, catching up would only stall the next frame too
+    f32 const MaxFrameTime = 0.1f;
+    GameState->TickAccumulator += Min(DeltaTime, MaxFrameTime);
+    
+    f32 TickTime = 1.0f / GameState->TicksPerSecond;
+    while (GameState->TickAccumulator >= TickTime)
+    {
+        temporary_memory TickMemory = BeginTemporaryMemory(Allocator.Transient);
+        SimulateTick(GameState, Input->Movement, TickTime, Allocator);
+        EndTemporaryMemory(TickMemory);
+        
+        GameState->TickAccumulator -= TickTime;
+    }
+    
     /*
     bool LevelCompleted = false;
     for (map_element& MapElement : GameState->Map->Elements)
@@ -333,7 +168,7 @@ SimulateGame(game_state* GameState, game_input* Input, f32 DeltaTime, memory_are
     if (LevelCompleted)
     {
         PlatformDebugOut(String("Level Completed\n"));
-        ChangeMap(GameState, GameState->MapIndex + 1, Arena);
+        ChangeMap(GameState, GameState->MapIndex + 1, Allocator.Permanent);
     }
 */
 }
@@ -396,53 +231,93 @@ static void DrawMapForEditor(render_group* Group, map_desc* Map)
     }
 }
 
-static void DrawMap(render_group* Group, map_desc* Map)
+static void
+DrawLaserBeam(render_group* Group, laser_beam LaserBeam)
+{
+    u32 RGB = (LaserBeam.Color & 0xFFFFFF);
+    
+    v2 Direction = UnitV(LaserBeam.End - LaserBeam.Start);
+    
+    PushLine(Group, LaserBeam.Start, LaserBeam.End, RGB | 0x40000000, 0.008f);
+    PushLine(Group, LaserBeam.Start, LaserBeam.End, RGB | 0x80000000, 0.005f);
+    PushLine(Group, LaserBeam.Start - 0.002f * Direction, LaserBeam.End + 0.002f * Direction, 
+             RGB | 0xC0000000, 0.0025f);
+    PushLine(Group, LaserBeam.Start - 0.002f * Direction, LaserBeam.End + 0.002f * Direction, 
+             RGB | 0xFF000000, 0.001f);
+}
+
+static void DrawMap(render_group* Group, map_desc* Map, f32 TickAlpha)
 {
-    for (rigid_body RigidBody : Map->RigidBodies)
+    for (u32 BodyIndex = 0; BodyIndex < Map->RigidBodies.Count; BodyIndex++)
     {
-        if (RigidBody.Type == RigidBody_AABB)
+        rigid_body* RigidBody = Map->RigidBodies + BodyIndex;
+        if (RigidBody->Type == RigidBody_AABB)
         {
-            PushRectangle(Group, RectOf(RigidBody), RigidBody.Color);
+            PushRectangle(Group, InterpolatedRectOf(&Map->Physics, BodyIndex, TickAlpha), RigidBody->Color);
         }
         else
         {
-            PushCircle(Group, RigidBody.P, 0.5f * RigidBody.Size.X, RigidBody.Color);
+            f32 Radius = 0.5f * InterpolatedSize(&Map->Physics, BodyIndex, TickAlpha).X;
+            PushCircle(Group, InterpolatedP(&Map->Physics, BodyIndex, TickAlpha), Radius, RigidBody->Color);
         }
     }
     
-    for (line Line : Map->Lines)
+    for (u32 LineIndex = 0; LineIndex < Map->Lines.Count; LineIndex++)
     {
-        PushLine(Group, Line.Start, Line.Start + Line.Offset, Line.Color, 0.01f);
+        line* Line = Map->Lines + LineIndex;
+        v2 Start = LinearInterpolate(Map->PrevLineStarts[LineIndex], Line->Start, TickAlpha);
+        PushLine(Group, Start, Start + Line->Offset, Line->Color, 0.01f);
     }
     
     for (u32 LaserIndex = 1; LaserIndex < Map->Lasers.Count; LaserIndex++)
     {
         laser* Laser = Map->Lasers + LaserIndex;
+        v2 Position = LinearInterpolate(Map->PrevLaserPositions[LaserIndex], Laser->Position, TickAlpha);
         
         v2 LaserSize = V2(0.01f, 0.01f);
-        PushRectangle(Group, Laser->Position - 0.5f * LaserSize, LaserSize, Laser->Color);
+        PushRectangle(Group, Position - 0.5f * LaserSize, LaserSize, Laser->Color);
+    }
+    
+    //Beams are interpolated between the last two traces like the bodies they end on. When a laser's path
+    //changed shape its beams can't be paired up, so the nearer of the two traces is drawn instead.
+    u32 FirstBeam = 0;
+    u32 PrevFirstBeam = 0;
+    for (u32 LaserIndex = 1; LaserIndex < Map->Lasers.Count; LaserIndex++)
+    {
+        u32 BeamCount = Map->LaserTraces[LaserIndex].BeamCount;
+        u32 PrevBeamCount = Map->PrevBeamCounts[LaserIndex];
         
-        bool IsActive = (Laser->ActivatedByIndex == 0) || Map->Entities[Laser->ActivatedByIndex].WasActivated;
-        if (IsActive)
+        if (BeamCount == PrevBeamCount)
         {
-            laser_beam LaserBeams[10] = {};
-            //TODO: Get count of laser beams of result
-            CalculateReflections(LaserBeams, ArrayCount(LaserBeams), Map, Laser);
-            
-            for (laser_beam LaserBeam : LaserBeams)
+            for (u32 Beam = 0; Beam < BeamCount; Beam++)
             {
-                u32 RGB = (LaserBeam.Color & 0xFFFFFF);
+                laser_beam Prev = Map->PrevLaserBeams[PrevFirstBeam + Beam];
+                laser_beam Current = Map->LaserBeams[FirstBeam + Beam];
                 
-                v2 Direction = UnitV(LaserBeam.End - LaserBeam.Start);
-                
-                PushLine(Group, LaserBeam.Start, LaserBeam.End, RGB | 0x40000000, 0.008f);
-                PushLine(Group, LaserBeam.Start, LaserBeam.End, RGB | 0x80000000, 0.005f);
-                PushLine(Group, LaserBeam.Start - 0.002f * Direction, LaserBeam.End + 0.002f * Direction, 
-                         RGB | 0xC0000000, 0.0025f);
-                PushLine(Group, LaserBeam.Start - 0.002f * Direction, LaserBeam.End + 0.002f * Direction, 
-                         RGB | 0xFF000000, 0.001f);
+                laser_beam Interpolated = {};
+                Interpolated.Start = LinearInterpolate(Prev.Start, Current.Start, TickAlpha);
+                Interpolated.End = LinearInterpolate(Prev.End, Current.End, TickAlpha);
+                Interpolated.Color = (TickAlpha < 0.5f) ? Prev.Color : Current.Color;
+                DrawLaserBeam(Group, Interpolated);
             }
         }
+        else if (TickAlpha < 0.5f)
+        {
+            for (u32 Beam = 0; Beam < PrevBeamCount; Beam++)
+            {
+                DrawLaserBeam(Group, Map->PrevLaserBeams[PrevFirstBeam + Beam]);
+            }
+        }
+        else
+        {
+            for (u32 Beam = 0; Beam < BeamCount; Beam++)
+            {
+                DrawLaserBeam(Group, Map->LaserBeams[FirstBeam + Beam]);
+            }
+        }
+        
+        FirstBeam += BeamCount;
+        PrevFirstBeam += PrevBeamCount;
     }
     
     //Transparent (window)
@@ -480,7 +355,8 @@ DrawGame(render_group* Group, game_state* GameState, memory_arena* Arena)
     }
     else
     {
-        DrawMap(Group, GameState->Map);
+        f32 TickAlpha = GameState->TickAccumulator * GameState->TicksPerSecond;
+        DrawMap(Group, GameState->Map, TickAlpha);
     }
 }
 
@@ -508,7 +384,7 @@ void GameUpdateAndRender(render_group* RenderGroup, game_state* GameState, float
     else
     {
         Assert(GameState->Map);
-        SimulateGame(GameState, Input, DeltaTime, Allocator.Permanent);
+        SimulateGame(GameState, Input, DeltaTime, Allocator);
         DrawGame(RenderGroup, GameState, Allocator.Transient);
     }
     
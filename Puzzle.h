@@ -1,6 +1,9 @@
 #include <vector>
 #include <string>
 
+struct work_queue;
+typedef void work_queue_callback(void* Data);
+
 enum map_elem_type
 {
     MapElem_Null,
@@ -47,6 +50,8 @@ struct map_element
     
     u32 AttachedTo;
     v2 AttachmentOffset;
+    
+    u32 BounceLimit; //Lasers only, 0 means the default. Maps saved before SavedMapVersion 2 load it as 0.
 };
 
 enum rigid_body_type
@@ -64,10 +69,7 @@ struct rigid_body
     bool Translucent;
     
     rigid_body_type Type;
-    v2 P;
-    v2 dP;
-    v2 Size;
-    f32 InvMass;
+    bool Static; //Never moves, so it is binned once into the static broadphase grid
     
     u32 ActivatedByIndex;
     v2 ActivatedP, UnactivatedP;
@@ -120,6 +122,248 @@ struct laser
     u32 Color;
     f32 Angle;
     u32 ActivatedByIndex;
+    u32 MaxBeams; //One more than its bounce limit
+    bool Powered; //Kept up to date by the activation graph
+};
+
+struct cached_contact
+{
+    u32 A, B;
+    u32 Stamp;
+    v2 Normal;
+    f32 Impulse; //Normal impulse the contact ended the step with
+};
+
+//Contacts from the last step keyed by body pair, so the solver can start from the impulses it ended with.
+//Only entries stamped with the current Stamp are in use, so the whole table is emptied by bumping it.
+struct contact_cache
+{
+    u32 Capacity; //Power of two
+    u32 Count;
+    u32 Stamp;
+    cached_contact* Entries;
+};
+
+//Hot rigid body data, indexed the same as map_desc::RigidBodies
+struct physics_world
+{
+    u32 BodyCount;
+    u32 Capacity;
+    
+    v2* P;
+    v2* dP;
+    v2* Size;
+    f32* InvMass;
+    
+    //State at the start of the last tick, drawing interpolates from here to the current state
+    v2* PrevP;
+    v2* PrevSize;
+    
+    //Sleeping, dynamic bodies that have rested for a while stop being simulated until something touches their island
+    bool SleepingEnabled;
+    bool* Awake; //Always false for static bodies, true for kinematic bodies only on steps they moved
+    f32* RestingTime;
+    u32* SleepIsland; //Lowest body index in the island the body fell asleep with
+    u32* NextInIsland; //Index + 1 of the next body that fell asleep in the same island, 0 ends the list
+    bool SleepingChanged; //An island fell asleep or woke since the broadphase last binned the sleeping bodies
+    rect* LastBounds; //Bounds at the start of the last step, to notice bodies moved outside the solver
+    
+    bool Multithreaded; //Solve contact islands on the platform work queue
+    bool ContinuousCollision; //Sweep bodies that move more than half their size in a step
+    
+    bool WarmStarting;
+    u32 VelocityIterations; //Most velocity passes per step, the solver stops early once impulses settle
+    contact_cache ContactCache;
+};
+
+struct broadphase_entry
+{
+    i32 CellX, CellY;
+    u32 Index; //Body index, except in the static grid where it indexes static_geometry::Bodies and in laser grids where it indexes laser_bvh::Occluders
+    u32 Next; //Index + 1 of the next entry in the same bucket, 0 ends the chain
+};
+
+struct broadphase_grid
+{
+    f32 CellSize;
+    u32 BucketCount; //Power of two
+    u32* Buckets; //Index + 1 of the first entry in each bucket
+    static_array<broadphase_entry> Entries;
+};
+
+//Colliders that never move, split out of the rigid bodies when the map's components are created and never
+//changed after. Only dynamic bodies query it, so no pair between two static bodies is ever made.
+struct static_geometry
+{
+    span<u32> Bodies; //Body index of each static collider
+    span<rect> Bounds; //Fat bounds in the same order
+    broadphase_grid Grid;
+    
+    span<u32> Kinematic; //Bodies nothing can push that still move, swept against one by one
+};
+
+struct body_pair
+{
+    u32 A, B; //A > B, matching the order of the brute force loop
+};
+
+struct physics_stats
+{
+    u32 BodyCount;
+    u32 BruteForcePairs;
+    u32 CandidatePairs;
+    u32 CulledPairs;
+    
+    u32 AwakeBodies;
+    u32 SleepingBodies;
+    u32 IslandCount;
+    u32 SolverJobs;
+    
+    u32 ContactCount;
+    u32 WarmStartedContacts;
+    u32 SolverIterations; //Velocity passes summed over every solver job
+    f32 DeepestPenetration; //Deepest overlap the solver started the step with
+    
+    u32 SweptBodies;
+    u32 SweptHits;
+};
+
+enum broadphase_mode
+{
+    Broadphase_Grid,
+    Broadphase_SweepAndPrune,
+    Broadphase_BruteForce
+};
+
+struct broadphase
+{
+    broadphase_mode Mode;
+    
+    span<u32> SortedBodies; //Indices of bodies that aren't static along X, kept between frames for sweep and prune
+    broadphase_grid SleepingGrid; //Sleeping bodies don't move, so they are only re-binned when an island falls asleep or wakes
+    
+    physics_stats Stats;
+};
+
+enum laser_occluder_type
+{
+    Occluder_Line,
+    Occluder_Body
+};
+
+struct laser_occluder
+{
+    laser_occluder_type Type;
+    u32 Index; //Into map_desc::Lines or map_desc::RigidBodies
+};
+
+struct laser_bvh_node
+{
+    rect Bounds;
+    u32 First; //First occluder of a leaf, or the first of an inner node's two adjacent children
+    u32 Count; //Occluders in a leaf, 0 for inner nodes
+};
+
+//Edges of every occluder laid out for the SIMD ray kernels. They are stored in occluder order, so a leaf's
+//edges are one contiguous run.
+struct laser_segments
+{
+    u32 Count; //The arrays have 7 more zeroed entries, so 8 wide loads never run off the end
+    f32* StartX;
+    f32* StartY;
+    f32* EdgeX; //End - Start
+    f32* EdgeY;
+    u32* Occluder; //Into laser_bvh::Occluders
+};
+
+//Bounding volume hierarchy over everything a laser can hit. It is built with the map's components and
+//refit when things move, children always come after their parent.
+struct laser_bvh
+{
+    span<laser_occluder> Occluders;
+    span<rect> OccluderBounds; //In the same order as Occluders
+    span<u32> FirstSegment; //Of each occluder, with one more entry for the end of the last
+    laser_segments Segments;
+    span<laser_bvh_node> Nodes;
+    u32 NodeCount;
+};
+
+//Occluders binned into cells the size of the editor's tiles, for walking rays cell by cell. Static bodies
+//are binned once with the map's components, everything else again every tick the grid is used.
+struct laser_grid
+{
+    broadphase_grid Static;
+    broadphase_grid Moving; //In the transient arena, only valid during the laser stage
+    rect Bounds; //Of every occluder, rays are only walked inside it
+};
+
+enum laser_trace_mode
+{
+    LaserTrace_BVH,
+    LaserTrace_Grid,
+    LaserTrace_BruteForce
+};
+
+//Per entity, what a beam has to match to activate it and what passing through it does to a beam's color
+struct entity_color
+{
+    u32 Color;
+    u32 Filter; //Byte-wise minimum taken with beams passing through, all ones for anything opaque
+};
+
+struct laser_beam
+{
+    v2 Start;
+    v2 End;
+    u32 Color;
+};
+
+//What a laser's last trace produced, reused until the laser changes or something on its path moves
+struct laser_trace
+{
+    bool Valid;
+    bool WasActive;
+    laser Laser; //As it was when traced
+    
+    u32 BeamCount;
+    span<laser_beam> Beams; //Laser.MaxBeams of them
+    static_array<u32> Activated; //Entities the beams hit in their own color
+};
+
+struct laser_stats
+{
+    u32 CacheHits;
+    u32 Retraces;
+    
+    u32 RaysCast; //One per beam of every retraced laser
+    u32 Bounces;  //Reflections and windows passed through
+};
+
+enum activation_target_type
+{
+    Activates_Body,
+    Activates_Laser
+};
+
+struct activation_target
+{
+    activation_target_type Type;
+    u32 Index; //Into map_desc::RigidBodies or map_desc::Lasers
+};
+
+//What each entity switches, built from map_element::ActivatedBy with the map's components. Entities only
+//notify their targets on the ticks their state flips, so a big circuit only pays for the part that changed.
+struct activation_graph
+{
+    span<u32> FirstTarget; //Of each entity, with one more entry for the end of the last
+    span<activation_target> Targets;
+    
+    static_array<u32> Activated; //Entities activated as of the last tick, the only ones that need clearing
+    static_array<u32> NowActivated; //Filled by the laser stage
+    
+    static_array<u32> MovingBodies; //Driven bodies still easing towards their target
+    bool* IsMoving; //Per body
+    bool* KeepsMoving; //Per body, driven bodies that something else also moves are never settled
 };
 
 struct map_desc
@@ -133,12 +377,38 @@ struct map_desc
     static_array<attachment> Attachments;
     static_array<line> Lines;
     static_array<laser> Lasers;
+    
+    physics_world Physics;
+    static_geometry StaticGeometry;
+    broadphase Broadphase;
+    
+    activation_graph ActivationGraph;
+    
+    span<entity_color> EntityColors; //Indexed the same as Entities
+    laser_trace_mode LaserMode;
+    laser_bvh LaserBVH;
+    laser_grid LaserGrid;
+    static_array<laser_beam> LaserBeams; //Written by the laser stage every tick, drawing only reads them
+    
+    bool LaserCaching;
+    bool MultithreadedLasers; //Trace lasers on the platform work queue
+    span<laser_trace> LaserTraces; //Indexed the same as Lasers
+    
+    //The start of the tick, so drawing can interpolate lines, lasers and beams like bodies from PrevP
+    span<v2> PrevLineStarts; //Indexed the same as Lines
+    span<v2> PrevLaserPositions; //Indexed the same as Lasers
+    static_array<laser_beam> PrevLaserBeams;
+    span<u32> PrevBeamCounts; //Indexed the same as Lasers
+    laser_stats LaserStats; //Since the map was loaded
 };
 
+//2 added map_element::BounceLimit. Files from before there was a version hold 0 or 1 there.
+u32 const SavedMapVersion = 2;
+
 struct saved_map_header
 {
     u32 ElementCount;
-    u32 Padding;
+    u32 Version;
     u32 ElementSize;
 };
 
@@ -198,6 +468,10 @@ struct game_state
     bool Editing;
     map_editor Editor;
     
+    //The simulation runs in fixed ticks, whatever the display rate
+    f32 TicksPerSecond;
+    f32 TickAccumulator;
+    
     console Console;
 };
 
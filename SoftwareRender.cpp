@@ -0,0 +1,839 @@
+//Rasterises a render_group on the CPU, for running without a GPU. It matches DirectX11Render: the same mapping
+//from game coordinates to pixels, the same shaders and the same SrcAlpha/InvSrcAlpha blend state.
+//The framebuffer is kept in linear light like the sRGB swap chain blends in, ResolveFramebuffer() encodes it.
+//Needs stb_truetype.h included before it.
+
+struct software_framebuffer
+{
+    u32 Width;
+    u32 Height;
+    f32* Pixels; //Linear RGBA, 4 floats a pixel, top row first
+};
+
+struct software_font
+{
+    stbtt_bakedchar BakedChars[128];
+    u8* Texture; //One byte of coverage per texel
+    u32 TextureWidth;
+    u32 TextureHeight;
+    f32 RasterisedSize;
+};
+
+static software_framebuffer
+CreateFramebuffer(memory_arena* Arena, u32 Width, u32 Height)
+{
+    software_framebuffer Result = {};
+    Result.Width = Width;
+    Result.Height = Height;
+    Result.Pixels = AllocArray(Arena, f32, 4 * Width * Height);
+    return Result;
+}
+
+//Bakes the same glyphs at the same size as the D3D11 font texture, so text lines up the same
+static software_font*
+CreateSoftwareFont(memory_arena* Arena, span<u8> TrueTypeFile)
+{
+    software_font* Result = AllocStruct(Arena, software_font);
+    Result->RasterisedSize = 64.0f;
+    Result->TextureWidth = 512;
+    Result->TextureHeight = 512;
+    Result->Texture = Alloc(Arena, Result->TextureWidth * Result->TextureHeight);
+    
+    if (TrueTypeFile.Memory)
+    {
+        stbtt_BakeFontBitmap(TrueTypeFile.Memory, 0, Result->RasterisedSize, Result->Texture,
+                             Result->TextureWidth, Result->TextureHeight, 0, 128, Result->BakedChars);
+    }
+    
+    return Result;
+}
+
+static f32
+SoftwareTextWidth(software_font* Font, string String)
+{
+    f32 Result = 0.0f;
+    f32 FontTexturePixelsToScreen = (6.0f) / Font->RasterisedSize / Font->TextureHeight;
+    for (u32 I = 0; I < String.Length; I++)
+    {
+        stbtt_bakedchar* BakedChar = Font->BakedChars + String.Text[I];
+        Result += BakedChar->xadvance * FontTexturePixelsToScreen;
+    }
+    return Result;
+}
+
+//
+//----------Span filling----------
+//
+
+//Every blend is Dst = SrcTerm + Dst * DstFactor. SrcTerm is the colour already multiplied by its alpha with the alpha
+//itself in W, and DstFactor is 1 - alpha for colour and 0 for alpha, which is what the blend state does.
+static void
+FillSpanScalar(f32* Pixels, u32 Count, v4 SrcTerm, v4 DstFactor)
+{
+    for (u32 I = 0; I < Count; I++)
+    {
+        f32* Pixel = Pixels + 4 * I;
+        Pixel[0] = SrcTerm.R + Pixel[0] * DstFactor.R;
+        Pixel[1] = SrcTerm.G + Pixel[1] * DstFactor.G;
+        Pixel[2] = SrcTerm.B + Pixel[2] * DstFactor.B;
+        Pixel[3] = SrcTerm.A + Pixel[3] * DstFactor.A;
+    }
+}
+
+static void
+FillSpanSSE2(f32* Pixels, u32 Count, v4 SrcTerm, v4 DstFactor)
+{
+    __m128 Src = _mm_setr_ps(SrcTerm.R, SrcTerm.G, SrcTerm.B, SrcTerm.A);
+    __m128 Factor = _mm_setr_ps(DstFactor.R, DstFactor.G, DstFactor.B, DstFactor.A);
+    
+    if (DstFactor.R == 0.0f && DstFactor.G == 0.0f && DstFactor.B == 0.0f && DstFactor.A == 0.0f)
+    {
+        //Opaque, nothing behind shows through
+        for (u32 I = 0; I < Count; I++)
+        {
+            _mm_storeu_ps(Pixels + 4 * I, Src);
+        }
+    }
+    else
+    {
+        for (u32 I = 0; I < Count; I++)
+        {
+            __m128 Dst = _mm_loadu_ps(Pixels + 4 * I);
+            _mm_storeu_ps(Pixels + 4 * I, _mm_add_ps(Src, _mm_mul_ps(Dst, Factor)));
+        }
+    }
+}
+
+TARGET_AVX2 static void
+FillSpanAVX2(f32* Pixels, u32 Count, v4 SrcTerm, v4 DstFactor)
+{
+    //Two pixels a lane
+    __m256 Src = _mm256_setr_ps(SrcTerm.R, SrcTerm.G, SrcTerm.B, SrcTerm.A, SrcTerm.R, SrcTerm.G, SrcTerm.B, SrcTerm.A);
+    __m256 Factor = _mm256_setr_ps(DstFactor.R, DstFactor.G, DstFactor.B, DstFactor.A,
+                                   DstFactor.R, DstFactor.G, DstFactor.B, DstFactor.A);
+    
+    u32 PairCount = Count / 2;
+    if (DstFactor.R == 0.0f && DstFactor.G == 0.0f && DstFactor.B == 0.0f && DstFactor.A == 0.0f)
+    {
+        for (u32 I = 0; I < PairCount; I++)
+        {
+            _mm256_storeu_ps(Pixels + 8 * I, Src);
+        }
+    }
+    else
+    {
+        for (u32 I = 0; I < PairCount; I++)
+        {
+            __m256 Dst = _mm256_loadu_ps(Pixels + 8 * I);
+            _mm256_storeu_ps(Pixels + 8 * I, _mm256_add_ps(Src, _mm256_mul_ps(Dst, Factor)));
+        }
+    }
+    
+    if (Count & 1)
+    {
+        FillSpanSSE2(Pixels + 8 * PairCount, 1, SrcTerm, DstFactor);
+    }
+}
+
+typedef void fill_span_kernel(f32* Pixels, u32 Count, v4 SrcTerm, v4 DstFactor);
+
+static fill_span_kernel*
+GetFillSpanKernel(simd_level Level)
+{
+    fill_span_kernel* Result = 0;
+    switch (Level)
+    {
+        case Simd_Scalar: Result = FillSpanScalar; break;
+        case Simd_SSE2:   Result = FillSpanSSE2; break;
+        case Simd_AVX2:   Result = FillSpanAVX2; break;
+        default: Assert(0);
+    }
+    return Result;
+}
+
+//
+//----------Rasterising----------
+//
+
+//Pixels are covered when their centre is inside a shape, like the D3D11 rasteriser. Game coordinates go from 0 to 1
+//across the screen and from 0 to ScreenTop up it.
+struct software_target
+{
+    software_framebuffer* Framebuffer;
+    fill_span_kernel* FillSpan;
+    
+    //The part of the framebuffer that may be drawn to
+    i32 MinX, MinY;
+    i32 MaxX, MaxY; //One past the last
+    
+    f32 ScaleX;
+    f32 ScaleY;
+};
+
+static inline v2
+ToPixels(software_target* Target, v2 P)
+{
+    v2 Result = V2(P.X * Target->ScaleX, (ScreenTop - P.Y) * Target->ScaleY);
+    return Result;
+}
+
+static inline v2
+ToGame(software_target* Target, f32 X, f32 Y)
+{
+    v2 Result = V2(X / Target->ScaleX, ScreenTop - Y / Target->ScaleY);
+    return Result;
+}
+
+//The first pixel whose centre is at or after Edge
+static inline i32
+FirstPixelAfter(f32 Edge)
+{
+    i32 Result = (i32)ceilf(Edge - 0.5f);
+    return Result;
+}
+
+static inline i32
+ClampI32(i32 Value, i32 Lo, i32 Hi)
+{
+    i32 Result = (Value < Lo) ? Lo : ((Value > Hi) ? Hi : Value);
+    return Result;
+}
+
+static inline v4
+ColorToV4(u32 Color)
+{
+    f32 A = (Color >> 24) / 255.0f;
+    f32 R = ((Color >> 16) & 0xFF) / 255.0f;
+    f32 G = ((Color >> 8) & 0xFF)  / 255.0f;
+    f32 B = (Color & 0xFF) / 255.0f;
+    
+    v4 Result = V4(R, G, B, A);
+    return Result;
+}
+
+static inline void
+BlendTerms(v4 Color, v4* SrcTerm, v4* DstFactor)
+{
+    *SrcTerm = V4(Color.R * Color.A, Color.G * Color.A, Color.B * Color.A, Color.A);
+    *DstFactor = V4(1.0f - Color.A, 1.0f - Color.A, 1.0f - Color.A, 0.0f);
+}
+
+static inline void
+FillRow(software_target* Target, i32 Y, i32 X0, i32 X1, v4 SrcTerm, v4 DstFactor)
+{
+    X0 = ClampI32(X0, Target->MinX, Target->MaxX);
+    X1 = ClampI32(X1, Target->MinX, Target->MaxX);
+    if (X0 < X1)
+    {
+        f32* Row = Target->Framebuffer->Pixels + 4 * ((u64)Y * Target->Framebuffer->Width);
+        Target->FillSpan(Row + 4 * X0, X1 - X0, SrcTerm, DstFactor);
+    }
+}
+
+static void
+RasteriseRectangle(software_target* Target, v2 Position, v2 Size, v4 Color)
+{
+    v2 Min = ToPixels(Target, V2(Position.X, Position.Y + Size.Y));
+    v2 Max = ToPixels(Target, V2(Position.X + Size.X, Position.Y));
+    
+    i32 X0 = FirstPixelAfter(Min.X);
+    i32 X1 = FirstPixelAfter(Max.X);
+    i32 Y0 = ClampI32(FirstPixelAfter(Min.Y), Target->MinY, Target->MaxY);
+    i32 Y1 = ClampI32(FirstPixelAfter(Max.Y), Target->MinY, Target->MaxY);
+    
+    v4 SrcTerm, DstFactor;
+    BlendTerms(Color, &SrcTerm, &DstFactor);
+    
+    for (i32 Y = Y0; Y < Y1; Y++)
+    {
+        FillRow(Target, Y, X0, X1, SrcTerm, DstFactor);
+    }
+}
+
+//The quad DirectX11Render draws for a line, in pixels and going round it
+static void
+LineCorners(software_target* Target, v2 Start, v2 End, f32 Thickness, v2* Corners)
+{
+    v2 XAxis = End - Start;
+    v2 YAxis = UnitV(Perp(XAxis)) * Thickness;
+    v2 Origin = Start - 0.5f * YAxis;
+    
+    Corners[0] = ToPixels(Target, Origin);
+    Corners[1] = ToPixels(Target, Origin + XAxis);
+    Corners[2] = ToPixels(Target, Origin + XAxis + YAxis);
+    Corners[3] = ToPixels(Target, Origin + YAxis);
+}
+
+//Lines are quads turned along the line. Each row is cut by the quad's four edges into a single span.
+static void
+RasteriseLine(software_target* Target, v2 Start, v2 End, f32 Thickness, v4 Color)
+{
+    v2 Corners[4];
+    LineCorners(Target, Start, End, Thickness, Corners);
+    
+    //Which side is inside depends on the winding, which flips with the direction of the line
+    f32 Area = 0.0f;
+    f32 MinY = Corners[0].Y, MaxY = Corners[0].Y;
+    for (u32 I = 0; I < 4; I++)
+    {
+        v2 P = Corners[I];
+        v2 Q = Corners[(I + 1) % 4];
+        Area += P.X * Q.Y - Q.X * P.Y;
+        MinY = Min(MinY, P.Y);
+        MaxY = Max(MaxY, P.Y);
+    }
+    if (Area == 0.0f)
+    {
+        return;
+    }
+    f32 Sign = (Area > 0.0f) ? 1.0f : -1.0f;
+    
+    i32 Y0 = ClampI32(FirstPixelAfter(MinY), Target->MinY, Target->MaxY);
+    i32 Y1 = ClampI32(FirstPixelAfter(MaxY), Target->MinY, Target->MaxY);
+    
+    v4 SrcTerm, DstFactor;
+    BlendTerms(Color, &SrcTerm, &DstFactor);
+    
+    for (i32 Y = Y0; Y < Y1; Y++)
+    {
+        f32 CentreY = Y + 0.5f;
+        f32 SpanMin = -1e30f;
+        f32 SpanMax = 1e30f;
+        
+        //Inside every edge: A * x + C >= 0
+        for (u32 I = 0; I < 4; I++)
+        {
+            v2 P = Corners[I];
+            v2 Q = Corners[(I + 1) % 4];
+            
+            f32 A = -Sign * (Q.Y - P.Y);
+            f32 C = Sign * ((Q.X - P.X) * (CentreY - P.Y) + (Q.Y - P.Y) * P.X);
+            
+            if (A > 0.0f)
+            {
+                SpanMin = Max(SpanMin, -C / A);
+            }
+            else if (A < 0.0f)
+            {
+                SpanMax = Min(SpanMax, -C / A);
+            }
+            else if (C < 0.0f)
+            {
+                SpanMax = SpanMin;
+            }
+        }
+        
+        if (SpanMin < SpanMax)
+        {
+            FillRow(Target, Y, FirstPixelAfter(SpanMin), FirstPixelAfter(SpanMax), SrcTerm, DstFactor);
+        }
+    }
+}
+
+//Half the width of an ellipse at DY from its centre, negative when the row misses it
+static inline f32
+EllipseHalfWidth(f32 RadiusX, f32 RadiusY, f32 DY)
+{
+    f32 Result = -1.0f;
+    if (RadiusX > 0.0f && RadiusY > 0.0f && Abs(DY) < RadiusY)
+    {
+        f32 T = DY / RadiusY;
+        Result = RadiusX * sqrtf(1.0f - T * T);
+    }
+    return Result;
+}
+
+//How much of the pixel at DX, DY from the centre is inside, from its signed distance to the edge in pixels.
+//The distance is first order for ellipses and exact when the radii match, the same as fwidth in circle.hlsl.
+static inline f32
+CircleCoverage(f32 DX, f32 DY, f32 RadiusX, f32 RadiusY)
+{
+    f32 QX = DX / RadiusX;
+    f32 QY = DY / RadiusY;
+    f32 Length = sqrtf(QX * QX + QY * QY);
+    f32 Gradient = sqrtf(QX * QX / (RadiusX * RadiusX) + QY * QY / (RadiusY * RadiusY));
+    
+    f32 Distance = (Gradient > 0.0f) ? (Length - 1.0f) * Length / Gradient : -Min(RadiusX, RadiusY);
+    
+    f32 Result = Clamp(0.5f - Distance, 0.0f, 1.0f);
+    return Result;
+}
+
+static void
+FillCircleEdge(software_target* Target, f32* Row, i32 X0, i32 X1, v2 Centre, f32 DY, f32 RadiusX, f32 RadiusY, v4 Color)
+{
+    for (i32 X = X0; X < X1; X++)
+    {
+        f32 Coverage = CircleCoverage(X + 0.5f - Centre.X, DY, RadiusX, RadiusY);
+        if (Coverage > 0.0f)
+        {
+            v4 SrcTerm, DstFactor;
+            BlendTerms(V4(Color.R, Color.G, Color.B, Coverage * Color.A), &SrcTerm, &DstFactor);
+            Target->FillSpan(Row + 4 * X, 1, SrcTerm, DstFactor);
+        }
+    }
+}
+
+//Anti-aliased with a signed distance like circle.hlsl. Pixels more than half a pixel inside the edge are filled a
+//span at a time, only the ring of pixels around the edge works out its coverage.
+static void
+RasteriseCircle(software_target* Target, v2 Position, f32 Radius, v4 Color)
+{
+    v2 Centre = ToPixels(Target, Position);
+    f32 RadiusX = Radius * Target->ScaleX;
+    f32 RadiusY = Radius * Target->ScaleY;
+    if (RadiusX <= 0.0f || RadiusY <= 0.0f)
+    {
+        return;
+    }
+    
+    i32 Y0 = ClampI32(FirstPixelAfter(Centre.Y - RadiusY - 0.5f), Target->MinY, Target->MaxY);
+    i32 Y1 = ClampI32(FirstPixelAfter(Centre.Y + RadiusY + 0.5f), Target->MinY, Target->MaxY);
+    
+    v4 SrcTerm, DstFactor;
+    BlendTerms(Color, &SrcTerm, &DstFactor);
+    
+    for (i32 Y = Y0; Y < Y1; Y++)
+    {
+        f32 DY = Y + 0.5f - Centre.Y;
+        f32 OuterHalfWidth = EllipseHalfWidth(RadiusX + 0.5f, RadiusY + 0.5f, DY);
+        f32 InnerHalfWidth = EllipseHalfWidth(RadiusX - 0.5f, RadiusY - 0.5f, DY);
+        if (OuterHalfWidth < 0.0f)
+        {
+            continue;
+        }
+        
+        i32 OuterX0 = ClampI32(FirstPixelAfter(Centre.X - OuterHalfWidth), Target->MinX, Target->MaxX);
+        i32 OuterX1 = ClampI32(FirstPixelAfter(Centre.X + OuterHalfWidth), Target->MinX, Target->MaxX);
+        i32 InnerX0 = OuterX1;
+        i32 InnerX1 = OuterX1;
+        if (InnerHalfWidth >= 0.0f)
+        {
+            InnerX0 = ClampI32(FirstPixelAfter(Centre.X - InnerHalfWidth), OuterX0, OuterX1);
+            InnerX1 = ClampI32(FirstPixelAfter(Centre.X + InnerHalfWidth), InnerX0, OuterX1);
+        }
+        
+        f32* Row = Target->Framebuffer->Pixels + 4 * ((u64)Y * Target->Framebuffer->Width);
+        FillCircleEdge(Target, Row, OuterX0, InnerX0, Centre, DY, RadiusX, RadiusY, Color);
+        if (InnerX0 < InnerX1)
+        {
+            Target->FillSpan(Row + 4 * InnerX0, InnerX1 - InnerX0, SrcTerm, DstFactor);
+        }
+        FillCircleEdge(Target, Row, InnerX1, OuterX1, Centre, DY, RadiusX, RadiusY, Color);
+    }
+}
+
+//background.hlsl: the colour, with grid lines every 1/25 lightened towards white
+static void
+RasteriseBackground(software_target* Target, v2 Position, v2 Size, v4 Color, memory_arena* TArena)
+{
+    f32 const CellSize = 1.0f / 25.0f;
+    f32 const LineThickness = 0.0025f;
+    
+    v2 Min = ToPixels(Target, V2(Position.X, Position.Y + Size.Y));
+    v2 Max = ToPixels(Target, V2(Position.X + Size.X, Position.Y));
+    
+    i32 X0 = ClampI32(FirstPixelAfter(Min.X), Target->MinX, Target->MaxX);
+    i32 X1 = ClampI32(FirstPixelAfter(Max.X), Target->MinX, Target->MaxX);
+    i32 Y0 = ClampI32(FirstPixelAfter(Min.Y), Target->MinY, Target->MaxY);
+    i32 Y1 = ClampI32(FirstPixelAfter(Max.Y), Target->MinY, Target->MaxY);
+    if (X0 >= X1)
+    {
+        return;
+    }
+    
+    v4 LineColor = V4(0.8f * Color.R + 0.2f, 0.8f * Color.G + 0.2f, 0.8f * Color.B + 0.2f, 1.0f);
+    
+    v4 SrcTerm, DstFactor, LineSrcTerm, LineDstFactor;
+    BlendTerms(Color, &SrcTerm, &DstFactor);
+    BlendTerms(LineColor, &LineSrcTerm, &LineDstFactor);
+    
+    temporary_memory TempMemory = BeginTemporaryMemory(TArena);
+    
+    //Whether a column is on a line is the same for every row
+    bool* IsLineColumn = AllocArray(TArena, bool, X1 - X0);
+    for (i32 X = X0; X < X1; X++)
+    {
+        f32 CellX = fmodf(ToGame(Target, X + 0.5f, 0.0f).X, CellSize);
+        IsLineColumn[X - X0] = (CellX < 0.5f * LineThickness || CellX > CellSize - 0.5f * LineThickness);
+    }
+    
+    for (i32 Y = Y0; Y < Y1; Y++)
+    {
+        f32 CellY = fmodf(ToGame(Target, 0.0f, Y + 0.5f).Y, CellSize);
+        if (CellY < 0.5f * LineThickness || CellY > CellSize - 0.5f * LineThickness)
+        {
+            FillRow(Target, Y, X0, X1, LineSrcTerm, LineDstFactor);
+            continue;
+        }
+        
+        //Runs of columns that are all on or all off a line
+        i32 RunStart = X0;
+        for (i32 X = X0 + 1; X <= X1; X++)
+        {
+            if (X == X1 || IsLineColumn[X - X0] != IsLineColumn[RunStart - X0])
+            {
+                if (IsLineColumn[RunStart - X0])
+                {
+                    FillRow(Target, Y, RunStart, X, LineSrcTerm, LineDstFactor);
+                }
+                else
+                {
+                    FillRow(Target, Y, RunStart, X, SrcTerm, DstFactor);
+                }
+                RunStart = X;
+            }
+        }
+    }
+    
+    EndTemporaryMemory(TempMemory);
+}
+
+//fontshaders.hlsl: the text colour with the glyph coverage as alpha. The colour's own alpha isn't used.
+static void
+RasteriseText(software_target* Target, software_font* Font, string Text, v2 Position, v4 Color)
+{
+    f32 FontTexturePixelsToScreen = (6.0f) / Font->RasterisedSize / Font->TextureHeight;
+    
+    f32 X = Position.X;
+    f32 Y = Position.Y;
+    
+    for (u32 I = 0; I < Text.Length; I++)
+    {
+        u8 Char = (u8)Text.Text[I];
+        Assert(Char < 128);
+        stbtt_bakedchar BakedChar = Font->BakedChars[Char];
+        
+        f32 X0 = X + BakedChar.xoff * FontTexturePixelsToScreen;
+        f32 Y1 = Y - BakedChar.yoff * FontTexturePixelsToScreen + 0.5f * Font->RasterisedSize * FontTexturePixelsToScreen;
+        
+        f32 Width = FontTexturePixelsToScreen * (f32)(BakedChar.x1 - BakedChar.x0);
+        f32 Height = FontTexturePixelsToScreen * (f32)(BakedChar.y1 - BakedChar.y0);
+        
+        X += BakedChar.xadvance * FontTexturePixelsToScreen;
+        
+        if (Width <= 0.0f || Height <= 0.0f)
+        {
+            continue;
+        }
+        
+        v2 Min = ToPixels(Target, V2(X0, Y1));
+        v2 Max = ToPixels(Target, V2(X0 + Width, Y1 - Height));
+        
+        i32 PixelX0 = ClampI32(FirstPixelAfter(Min.X), Target->MinX, Target->MaxX);
+        i32 PixelX1 = ClampI32(FirstPixelAfter(Max.X), Target->MinX, Target->MaxX);
+        i32 PixelY0 = ClampI32(FirstPixelAfter(Min.Y), Target->MinY, Target->MaxY);
+        i32 PixelY1 = ClampI32(FirstPixelAfter(Max.Y), Target->MinY, Target->MaxY);
+        
+        //Texels per pixel, the glyph's top row is at its top edge
+        f32 TexelsPerPixelX = (BakedChar.x1 - BakedChar.x0) / (Max.X - Min.X);
+        f32 TexelsPerPixelY = (BakedChar.y1 - BakedChar.y0) / (Max.Y - Min.Y);
+        
+        for (i32 PixelY = PixelY0; PixelY < PixelY1; PixelY++)
+        {
+            i32 TexelY = BakedChar.y0 + (i32)((PixelY + 0.5f - Min.Y) * TexelsPerPixelY);
+            TexelY = ClampI32(TexelY, BakedChar.y0, BakedChar.y1 - 1);
+            u8* TexelRow = Font->Texture + TexelY * Font->TextureWidth;
+            
+            for (i32 PixelX = PixelX0; PixelX < PixelX1; PixelX++)
+            {
+                i32 TexelX = BakedChar.x0 + (i32)((PixelX + 0.5f - Min.X) * TexelsPerPixelX);
+                TexelX = ClampI32(TexelX, BakedChar.x0, BakedChar.x1 - 1);
+                
+                f32 Coverage = TexelRow[TexelX] / 255.0f;
+                if (Coverage > 0.0f)
+                {
+                    v4 SrcTerm, DstFactor;
+                    BlendTerms(V4(Color.R, Color.G, Color.B, Coverage), &SrcTerm, &DstFactor);
+                    FillRow(Target, PixelY, PixelX, PixelX + 1, SrcTerm, DstFactor);
+                }
+            }
+        }
+    }
+}
+
+static void
+RasteriseShape(software_target* Target, render_shape* Shape, software_font* Font, memory_arena* TArena)
+{
+    v4 Color = ColorToV4(Shape->Color);
+    
+    switch (Shape->Type)
+    {
+        case Render_Rectangle:
+        {
+            RasteriseRectangle(Target, Shape->Rectangle.Position, Shape->Rectangle.Size, Color);
+        } break;
+        case Render_Circle:
+        {
+            RasteriseCircle(Target, Shape->Circle.Position, Shape->Circle.Radius, Color);
+        } break;
+        case Render_Line:
+        {
+            RasteriseLine(Target, Shape->Line.Start, Shape->Line.End, Shape->Line.Thickness, Color);
+        } break;
+        case Render_Text:
+        {
+            RasteriseText(Target, Font, Shape->Text.String, Shape->Text.Position, Color);
+        } break;
+        case Render_Background:
+        {
+            RasteriseBackground(Target, Shape->Rectangle.Position, Shape->Rectangle.Size, Color, TArena);
+        } break;
+        default: Assert(0);
+    }
+}
+
+static void
+ClearFramebuffer(software_framebuffer* Framebuffer, v4 Color)
+{
+    fill_span_kernel* FillSpan = GetFillSpanKernel(GlobalSimdLevel);
+    FillSpan(Framebuffer->Pixels, Framebuffer->Width * Framebuffer->Height, Color, V4(0.0f, 0.0f, 0.0f, 0.0f));
+}
+
+static software_target
+CreateTarget(software_framebuffer* Framebuffer, i32 MinX, i32 MinY, i32 MaxX, i32 MaxY)
+{
+    software_target Result = {};
+    Result.Framebuffer = Framebuffer;
+    Result.FillSpan = GetFillSpanKernel(GlobalSimdLevel);
+    Result.MinX = MinX;
+    Result.MinY = MinY;
+    Result.MaxX = MaxX;
+    Result.MaxY = MaxY;
+    Result.ScaleX = (f32)Framebuffer->Width;
+    Result.ScaleY = Framebuffer->Height / ScreenTop;
+    return Result;
+}
+
+//Conservative bounds in pixels of everything a shape can touch
+static rect
+ShapeBounds(software_target* Target, render_shape* Shape, software_font* Font)
+{
+    rect Result = {};
+    switch (Shape->Type)
+    {
+        case Render_Rectangle: case Render_Background:
+        {
+            Result.MinCorner = ToPixels(Target, V2(Shape->Rectangle.Position.X, Shape->Rectangle.Position.Y + Shape->Rectangle.Size.Y));
+            Result.MaxCorner = ToPixels(Target, V2(Shape->Rectangle.Position.X + Shape->Rectangle.Size.X, Shape->Rectangle.Position.Y));
+        } break;
+        case Render_Circle:
+        {
+            //And a pixel around it for the anti-aliased edge
+            f32 Radius = Shape->Circle.Radius;
+            Result.MinCorner = ToPixels(Target, Shape->Circle.Position + V2(-Radius, Radius)) - V2(1.0f, 1.0f);
+            Result.MaxCorner = ToPixels(Target, Shape->Circle.Position + V2(Radius, -Radius)) + V2(1.0f, 1.0f);
+        } break;
+        case Render_Line:
+        {
+            v2 Corners[4];
+            LineCorners(Target, Shape->Line.Start, Shape->Line.End, Shape->Line.Thickness, Corners);
+            
+            Result.MinCorner = Corners[0];
+            Result.MaxCorner = Corners[0];
+            for (v2 Corner : Corners)
+            {
+                Result.MinCorner = V2(Min(Result.MinCorner.X, Corner.X), Min(Result.MinCorner.Y, Corner.Y));
+                Result.MaxCorner = V2(Max(Result.MaxCorner.X, Corner.X), Max(Result.MaxCorner.Y, Corner.Y));
+            }
+        } break;
+        case Render_Text:
+        {
+            //Glyphs reach at most a whole rasterised line above and below the position
+            f32 FontTexturePixelsToScreen = (6.0f) / Font->RasterisedSize / Font->TextureHeight;
+            f32 LineHeight = Font->RasterisedSize * FontTexturePixelsToScreen;
+            f32 Width = SoftwareTextWidth(Font, Shape->Text.String);
+            
+            v2 P = Shape->Text.Position;
+            Result.MinCorner = ToPixels(Target, V2(P.X - LineHeight, P.Y + 2.0f * LineHeight));
+            Result.MaxCorner = ToPixels(Target, V2(P.X + Width + LineHeight, P.Y - 2.0f * LineHeight));
+        } break;
+        default: Assert(0);
+    }
+    return Result;
+}
+
+u32 const SoftwareTileSize = 64;
+
+struct software_tile_job
+{
+    render_group* Group;
+    software_framebuffer* Framebuffer;
+    software_font* Font;
+    
+    u32 TilesX;
+    u32 TileCount;
+    u32* FirstShape; //Per tile into ShapeIndices, with one more at the end
+    u32* ShapeIndices;
+    
+    //The job draws tiles FirstTile, FirstTile + TileStride, ... so busy parts of the screen are spread out
+    u32 FirstTile;
+    u32 TileStride;
+    
+    memory_arena Arena;
+};
+
+//Tiles don't overlap, so every job writes its own pixels and nothing has to be locked
+static void
+RasteriseTilesJob(void* Data)
+{
+    software_tile_job* Job = (software_tile_job*)Data;
+    software_framebuffer* Framebuffer = Job->Framebuffer;
+    
+    for (u32 TileIndex = Job->FirstTile; TileIndex < Job->TileCount; TileIndex += Job->TileStride)
+    {
+        i32 MinX = (TileIndex % Job->TilesX) * SoftwareTileSize;
+        i32 MinY = (TileIndex / Job->TilesX) * SoftwareTileSize;
+        i32 MaxX = Min(MinX + (i32)SoftwareTileSize, (i32)Framebuffer->Width);
+        i32 MaxY = Min(MinY + (i32)SoftwareTileSize, (i32)Framebuffer->Height);
+        
+        software_target Target = CreateTarget(Framebuffer, MinX, MinY, MaxX, MaxY);
+        
+        for (u32 Index = Job->FirstShape[TileIndex]; Index < Job->FirstShape[TileIndex + 1]; Index++)
+        {
+            RasteriseShape(&Target, Job->Group->Shapes + Job->ShapeIndices[Index], Job->Font, &Job->Arena);
+        }
+    }
+}
+
+//Draws the shapes in the order they were pushed, later shapes blend over earlier ones.
+//Shapes are binned into screen tiles first, keeping that order within each tile, and the tiles are drawn
+//in batches on the work queue.
+static void
+SoftwareRender(render_group* Group, software_framebuffer* Framebuffer, software_font* Font, memory_arena* TArena)
+{
+    temporary_memory TempMemory = BeginTemporaryMemory(TArena);
+    
+    software_target Whole = CreateTarget(Framebuffer, 0, 0, Framebuffer->Width, Framebuffer->Height);
+    
+    u32 TilesX = (Framebuffer->Width + SoftwareTileSize - 1) / SoftwareTileSize;
+    u32 TilesY = (Framebuffer->Height + SoftwareTileSize - 1) / SoftwareTileSize;
+    u32 TileCount = TilesX * TilesY;
+    
+    //Binning. Count the shapes in each tile, then fill the lists in shape order.
+    i32* TileRanges = AllocArray(TArena, i32, 4 * Group->ShapeCount); //MinX, MinY, MaxX, MaxY inclusive
+    u32* FirstShape = AllocArray(TArena, u32, TileCount + 1);
+    
+    for (u32 ShapeIndex = 0; ShapeIndex < Group->ShapeCount; ShapeIndex++)
+    {
+        rect Bounds = ShapeBounds(&Whole, Group->Shapes + ShapeIndex, Font);
+        
+        i32* Range = TileRanges + 4 * ShapeIndex;
+        Range[0] = ClampI32((i32)floorf(Bounds.MinCorner.X) / (i32)SoftwareTileSize, 0, TilesX - 1);
+        Range[1] = ClampI32((i32)floorf(Bounds.MinCorner.Y) / (i32)SoftwareTileSize, 0, TilesY - 1);
+        Range[2] = ClampI32((i32)floorf(Bounds.MaxCorner.X) / (i32)SoftwareTileSize, 0, TilesX - 1);
+        Range[3] = ClampI32((i32)floorf(Bounds.MaxCorner.Y) / (i32)SoftwareTileSize, 0, TilesY - 1);
+        
+        //Off screen
+        if (Bounds.MaxCorner.X < 0.0f || Bounds.MaxCorner.Y < 0.0f || 
+            Bounds.MinCorner.X >= Framebuffer->Width || Bounds.MinCorner.Y >= Framebuffer->Height)
+        {
+            Range[0] = 1;
+            Range[2] = 0;
+        }
+        
+        for (i32 TileY = Range[1]; TileY <= Range[3]; TileY++)
+        {
+            for (i32 TileX = Range[0]; TileX <= Range[2]; TileX++)
+            {
+                FirstShape[TileY * TilesX + TileX + 1]++;
+            }
+        }
+    }
+    
+    for (u32 TileIndex = 0; TileIndex < TileCount; TileIndex++)
+    {
+        FirstShape[TileIndex + 1] += FirstShape[TileIndex];
+    }
+    
+    u32* ShapeIndices = AllocArray(TArena, u32, FirstShape[TileCount]);
+    u32* Cursors = AllocArray(TArena, u32, TileCount);
+    memcpy(Cursors, FirstShape, TileCount * sizeof(u32));
+    
+    for (u32 ShapeIndex = 0; ShapeIndex < Group->ShapeCount; ShapeIndex++)
+    {
+        i32* Range = TileRanges + 4 * ShapeIndex;
+        for (i32 TileY = Range[1]; TileY <= Range[3]; TileY++)
+        {
+            for (i32 TileX = Range[0]; TileX <= Range[2]; TileX++)
+            {
+                ShapeIndices[Cursors[TileY * TilesX + TileX]++] = ShapeIndex;
+            }
+        }
+    }
+    
+    //Drawing
+    u32 const MaxJobCount = 64;
+    u32 JobCount = (TileCount < MaxJobCount) ? TileCount : MaxJobCount;
+    u64 JobArenaSize = SoftwareTileSize * sizeof(bool) + Kilobytes(1); //The background's column mask
+    
+    software_tile_job* Jobs = AllocArray(TArena, software_tile_job, JobCount);
+    for (u32 JobIndex = 0; JobIndex < JobCount; JobIndex++)
+    {
+        software_tile_job* Job = Jobs + JobIndex;
+        Job->Group = Group;
+        Job->Framebuffer = Framebuffer;
+        Job->Font = Font;
+        Job->TilesX = TilesX;
+        Job->TileCount = TileCount;
+        Job->FirstShape = FirstShape;
+        Job->ShapeIndices = ShapeIndices;
+        Job->FirstTile = JobIndex;
+        Job->TileStride = JobCount;
+        Job->Arena = CreateSubArena(TArena, JobArenaSize);
+    }
+    
+    bool Threaded = GlobalWorkQueue && JobCount > 1;
+    for (u32 JobIndex = 0; JobIndex < JobCount; JobIndex++)
+    {
+        if (Threaded)
+        {
+            PlatformAddWork(GlobalWorkQueue, RasteriseTilesJob, Jobs + JobIndex);
+        }
+        else
+        {
+            RasteriseTilesJob(Jobs + JobIndex);
+        }
+    }
+    
+    if (Threaded)
+    {
+        PlatformCompleteAllWork(GlobalWorkQueue);
+    }
+    
+    EndTemporaryMemory(TempMemory);
+}
+
+static inline u8
+LinearToSRGB(f32 Value)
+{
+    Value = (Value < 0.0f) ? 0.0f : ((Value > 1.0f) ? 1.0f : Value);
+    f32 Encoded = (Value <= 0.0031308f) ? 12.92f * Value : 1.055f * powf(Value, 1.0f / 2.4f) - 0.055f;
+    u8 Result = (u8)(255.0f * Encoded + 0.5f);
+    return Result;
+}
+
+//Writes 8 bit sRGB RGBA, R first in memory, which is what the swap chain would show
+static void
+ResolveFramebuffer(software_framebuffer* Framebuffer, u8* Out)
+{
+    //Colour goes through a table, the alpha channel is stored as it is
+    u8 Table[4096];
+    for (u32 I = 0; I < ArrayCount(Table); I++)
+    {
+        Table[I] = LinearToSRGB(I / (f32)(ArrayCount(Table) - 1));
+    }
+    
+    u32 PixelCount = Framebuffer->Width * Framebuffer->Height;
+    for (u32 I = 0; I < PixelCount; I++)
+    {
+        f32* Pixel = Framebuffer->Pixels + 4 * I;
+        for (u32 Channel = 0; Channel < 3; Channel++)
+        {
+            f32 Value = (Pixel[Channel] < 0.0f) ? 0.0f : ((Pixel[Channel] > 1.0f) ? 1.0f : Pixel[Channel]);
+            Out[4 * I + Channel] = Table[(u32)(Value * (ArrayCount(Table) - 1) + 0.5f)];
+        }
+        f32 Alpha = (Pixel[3] < 0.0f) ? 0.0f : ((Pixel[3] > 1.0f) ? 1.0f : Pixel[3]);
+        Out[4 * I + 3] = (u8)(255.0f * Alpha + 0.5f);
+    }
+}
@@ -1,6 +1,13 @@
 #include <stdint.h>
 #include <cstdarg>
 #include <stdio.h>
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
 
 typedef uint64_t u64;
 typedef int64_t i64;
@@ -60,6 +67,12 @@ StringsAreEqual(string A, string B)
     return true;
 }
 
+//So the game code also builds outside MSVC, for the headless builds
+#if !defined(_MSC_VER)
+#define __debugbreak() __builtin_trap()
+#define vsprintf_s vsnprintf
+#endif
+
 #if DEBUG
 #define Assert(x) DoAssert(x)
 #else
@@ -75,6 +88,72 @@ DoAssert(bool Condition)
 	}
 }
 
+//
+//----------SIMD----------
+//
+
+#if defined(_MSC_VER)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+enum simd_level
+{
+    Simd_Scalar,
+    Simd_SSE2,
+    Simd_AVX2
+};
+
+simd_level GlobalSimdLevel;
+simd_level GlobalMaxSimdLevel;
+
+static void
+CPUID(int* Info, int Leaf, int SubLeaf)
+{
+#if defined(_MSC_VER)
+    __cpuidex(Info, Leaf, SubLeaf);
+#else
+    __cpuid_count(Leaf, SubLeaf, Info[0], Info[1], Info[2], Info[3]);
+#endif
+}
+
+static u64
+XGETBV(u32 Index)
+{
+#if defined(_MSC_VER)
+    return _xgetbv(Index);
+#else
+    u32 Low, High;
+    __asm__ volatile("xgetbv" : "=a"(Low), "=d"(High) : "c"(Index));
+    return ((u64)High << 32) | Low;
+#endif
+}
+
+static simd_level
+DetectSimdLevel()
+{
+    simd_level Result = Simd_SSE2; //Every x64 CPU has SSE2
+    
+    int Info[4] = {};
+    CPUID(Info, 1, 0);
+    
+    bool OSUsesXSave = (Info[2] & (1 << 27)) != 0;
+    bool HasAVX = (Info[2] & (1 << 28)) != 0;
+    
+    //The OS also has to save the YMM registers on context switches
+    if (OSUsesXSave && HasAVX && (XGETBV(0) & 0x6) == 0x6)
+    {
+        CPUID(Info, 7, 0);
+        if (Info[1] & (1 << 5))
+        {
+            Result = Simd_AVX2;
+        }
+    }
+    
+    return Result;
+}
+
 enum memory_arena_type
 {
 	NORMAL, PERMANENT, TRANSIENT
@@ -92,7 +171,7 @@ struct memory_arena
 (Type*)Alloc(Arena, sizeof(Type))
 
 #define AllocArray(Arena, Type, Count) \
-(Type*)Alloc(Arena, Count * sizeof(Type))
+(Type*)Alloc(Arena, (Count) * sizeof(Type))
 
 static u8*
 Alloc(memory_arena* Arena, u64 Size)
@@ -144,6 +223,27 @@ ResetArena(memory_arena* Arena)
 	Arena->Used = 0;
 }
 
+//Everything allocated between Begin and End is freed again at End
+struct temporary_memory
+{
+    memory_arena* Arena;
+    u64 Used;
+};
+
+static inline temporary_memory
+BeginTemporaryMemory(memory_arena* Arena)
+{
+    temporary_memory Result = {Arena, Arena->Used};
+    return Result;
+}
+
+static inline void
+EndTemporaryMemory(temporary_memory TempMemory)
+{
+    Assert(TempMemory.Arena->Used >= TempMemory.Used);
+    TempMemory.Arena->Used = TempMemory.Used;
+}
+
 struct allocator
 {
 	memory_arena* Permanent;
@@ -202,7 +302,7 @@ type* end(span<type> Span)
 
 #define AllocSpan(Arena, Type, Count) \
 (span<Type> {AllocArray(Arena, Type, Count), Count})
-/*
+
 template <typename type>
 span<type>
 BeginSpan(memory_arena* Arena)
@@ -212,7 +312,7 @@ BeginSpan(memory_arena* Arena)
     
 	return Span;
 }
-*/
+
 template <typename type>
 void
 EndSpan(span<type>& Span, memory_arena* Arena)
@@ -0,0 +1,43 @@
+struct VS_Input
+{
+    float2 corner : CORNER;
+    float2 a : A;
+    float2 b : B;
+    float4 color : COL;
+};
+
+struct VS_Output
+{
+    float4 position : SV_POSITION;
+    float4 color : COL;
+    float2 offset : OFFSET;
+    float radius : RADIUS;
+};
+
+//A couple of pixels at 720p, so the quad has room for the anti-aliased edge
+static const float edge_margin = 0.002f;
+
+//One quad per circle, a is the centre and b.x the radius
+VS_Output vs_main(VS_Input input)
+{
+    float radius = input.b.x;
+    float2 offset = (2.0f * input.corner - 1.0f) * (radius + edge_margin);
+    float2 pos = input.a + offset;
+    
+    VS_Output output;
+    output.position = float4(pos.x * 2.0f - 1.0f, 2.0f / 0.5625f * pos.y - 1.0f, 0.0f, 1.0f);
+    output.color = input.color.zyxw;
+    output.offset = offset;
+    output.radius = radius;
+    
+    return output;
+}
+
+//Signed distance to the edge, fwidth turns it into pixels so the edge is half a pixel of blend either side
+float4 ps_main(VS_Output input) : SV_TARGET
+{
+    float distance = length(input.offset) - input.radius;
+    float coverage = saturate(0.5f - distance / fwidth(distance));
+    
+    return float4(input.color.rgb, input.color.a * coverage);
+}
@@ -0,0 +1,42 @@
+struct VS_Input
+{
+    float2 corner : CORNER;
+    float2 a : A;
+    float2 b : B;
+    float thickness : THICKNESS;
+    float4 color : COL;
+};
+
+struct VS_Output
+{
+    float4 position : SV_POSITION;
+    float4 color : COL;
+};
+
+//Rectangles have zero thickness, a is their position and b their size. Lines go from a to b.
+VS_Output vs_main(VS_Input input)
+{
+    float2 origin = input.a;
+    float2 x_axis = float2(input.b.x, 0.0f);
+    float2 y_axis = float2(0.0f, input.b.y);
+    
+    if (input.thickness != 0.0f)
+    {
+        x_axis = input.b - input.a;
+        y_axis = normalize(float2(-x_axis.y, x_axis.x)) * input.thickness;
+        origin = input.a - 0.5f * y_axis;
+    }
+    
+    float2 pos = origin + input.corner.x * x_axis + input.corner.y * y_axis;
+    
+    VS_Output output;
+    output.position = float4(pos.x * 2.0f - 1.0f, 2.0f / 0.5625f * pos.y - 1.0f, 0.0f, 1.0f);
+    output.color = input.color.zyxw;
+    
+    return output;
+}
+
+float4 ps_main(VS_Output input) : SV_TARGET
+{
+    return input.color;
+}